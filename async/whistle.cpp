@@ -1,25 +1,65 @@
 #include "whistle.h"
 
-// XMLSpreadsheetWriter implementation (unchanged)
-std::string XMLSpreadsheetWriter::escapeXML(const std::string& text) {
-    if (text.empty()) {
-        return text;
+// XMLSpreadsheetWriter implementation
+// Returns the first of & < > " ' in [p, end), or end
+static const char* findXMLSpecial(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
+    
+    for (; p + 16 <= end; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, amp), _mm_cmpeq_epi8(block, lt)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, gt), _mm_cmpeq_epi8(block, quot)));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, apos));
+        
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
     }
+#endif
     
-    std::string escaped;
-    escaped.reserve(text.length() * 2);
+    for (; p < end; ++p) {
+        char c = *p;
+        if (c == '&' || c == '<' || c == '>' || c == '"' || c == '\'') {
+            return p;
+        }
+    }
+    return end;
+}
+
+// Appends text to out with XML special characters escaped; the clean runs between
+// them are copied in bulk
+void XMLSpreadsheetWriter::appendEscaped(std::string& out, std::string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
     
-    for (size_t i = 0; i < text.length(); ++i) {
-        char c = text[i];
-        switch (c) {
-            case '&': escaped += "&amp;"; break;
-            case '<': escaped += "&lt;"; break;
-            case '>': escaped += "&gt;"; break;
-            case '"': escaped += "&quot;"; break;
-            case '\'': escaped += "&apos;"; break;
-            default: escaped += c; break;
+    while (p < end) {
+        const char* special = findXMLSpecial(p, end);
+        out.append(p, special);
+        if (special == end) {
+            break;
+        }
+        
+        switch (*special) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += "&apos;"; break;
         }
+        p = special + 1;
     }
+}
+
+std::string XMLSpreadsheetWriter::escapeXML(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.length() + text.length() / 8);
+    appendEscaped(escaped, text);
     return escaped;
 }
 
@@ -40,24 +80,89 @@ std::string XMLSpreadsheetWriter::cleanSheetName(const std::string& name) {
     return clean;
 }
 
-XMLSpreadsheetWriter::XMLSpreadsheetWriter(const std::string& filename) : file(filename) {}
+XMLSpreadsheetWriter::XMLSpreadsheetWriter(const std::string& filename, size_t buffer_limit) 
+    : file_buffer(FILE_BUFFER_SIZE), buffer_limit(buffer_limit) {
+    // The buffer has to be installed before the file is opened to take effect
+    file.rdbuf()->pubsetbuf(file_buffer.data(), static_cast<std::streamsize>(file_buffer.size()));
+    file.open(filename, std::ios::binary);
+}
 
 XMLSpreadsheetWriter::~XMLSpreadsheetWriter() {
+    for (auto& entry : worksheets) {
+        if (entry.second.spill) {
+            std::fclose(entry.second.spill);
+        }
+    }
+    
     if (file.is_open()) {
         file.close();
     }
 }
 
 void XMLSpreadsheetWriter::addWorksheet(const std::string& name) {
-    std::string clean_name = cleanSheetName(name);
-    worksheets[clean_name] = std::vector<std::vector<std::string>>();
+    // Adding an existing sheet keeps its rows
+    worksheets.emplace(cleanSheetName(name), Worksheet());
 }
 
-void XMLSpreadsheetWriter::addRow(const std::string& worksheet_name, const std::vector<std::string>& row) {
-    std::string clean_name = cleanSheetName(worksheet_name);
-    if (worksheets.find(clean_name) != worksheets.end()) {
-        worksheets[clean_name].push_back(row);
+void XMLSpreadsheetWriter::addRow(const std::string& worksheet_name, std::initializer_list<SpreadsheetCell> row) {
+    // Names are normally clean already, which avoids building a cleaned copy per row
+    auto it = worksheets.find(worksheet_name);
+    if (it == worksheets.end()) {
+        it = worksheets.find(cleanSheetName(worksheet_name));
+        if (it == worksheets.end()) {
+            return;
+        }
+    }
+    
+    Worksheet& sheet = it->second;
+    std::string& out = sheet.buffer;
+    size_t rendered_from = out.size();
+    bool is_header = (sheet.row_count == 0);
+    
+    out += "   <Row>\n";
+    for (const SpreadsheetCell& cell : row) {
+        out += is_header ? "    <Cell ss:StyleID=\"Header\">\n" : "    <Cell ss:StyleID=\"Cell\">\n";
+        if (cell.is_number) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), cell.number);
+            out += "     <Data ss:Type=\"Number\">";
+            out.append(digits, result.ptr);
+        } else {
+            out += "     <Data ss:Type=\"String\">";
+            appendEscaped(out, cell.text);
+        }
+        out += "</Data>\n";
+        out += "    </Cell>\n";
+    }
+    out += "   </Row>\n";
+    
+    sheet.row_count++;
+    buffered_bytes += out.size() - rendered_from;
+    if (buffered_bytes > buffer_limit) {
+        spillWorksheets();
+    }
+}
+
+void XMLSpreadsheetWriter::spillWorksheets() {
+    for (auto& entry : worksheets) {
+        Worksheet& sheet = entry.second;
+        if (sheet.buffer.empty()) {
+            continue;
+        }
+        
+        if (!sheet.spill) {
+            sheet.spill = std::tmpfile();
+            if (!sheet.spill) {
+                throw std::runtime_error("Failed to create spill file for worksheet: " + entry.first);
+            }
+        }
+        if (std::fwrite(sheet.buffer.data(), 1, sheet.buffer.size(), sheet.spill) != sheet.buffer.size()) {
+            throw std::runtime_error("Failed to write spill file for worksheet: " + entry.first);
+        }
+        
+        std::string().swap(sheet.buffer); // Release the memory, not just the contents
     }
+    buffered_bytes = 0;
 }
 
 bool XMLSpreadsheetWriter::writeFile() {
@@ -102,7 +207,8 @@ bool XMLSpreadsheetWriter::writeFile() {
     file << " </Styles>\n";
     
     // Write worksheets
-    for (const auto& [sheet_name, rows] : worksheets) {
+    std::vector<char> copy_buffer(64 * 1024);
+    for (auto& [sheet_name, sheet] : worksheets) {
         file << " <Worksheet ss:Name=\"" << escapeXML(sheet_name) << "\">\n";
         file << "  <Table>\n";
         
@@ -116,39 +222,24 @@ bool XMLSpreadsheetWriter::writeFile() {
         file << "   <Column ss:Width=\"90\"/>\n";  // Risk
         file << "   <Column ss:Width=\"360\"/>\n"; // Statement
         
-        for (size_t i = 0; i < rows.size(); ++i) {
-            const auto& row = rows[i];
-            file << "   <Row>\n";
-            
-            for (size_t j = 0; j < row.size(); ++j) {
-                std::string style_id = (i == 0) ? "Header" : "Cell";
-                std::string cell_data = escapeXML(row[j]);
-                
-                bool is_number = false;
-                if (j == 2 && i > 0) { // Line number column
-                    try {
-                        std::stoi(row[j]);
-                        is_number = true;
-                    } catch (...) {
-                        is_number = false;
-                    }
-                }
-                
-                file << "    <Cell ss:StyleID=\"" << style_id << "\">\n";
-                if (is_number) {
-                    file << "     <Data ss:Type=\"Number\">" << cell_data << "</Data>\n";
-                } else {
-                    file << "     <Data ss:Type=\"String\">" << cell_data << "</Data>\n";
-                }
-                file << "    </Cell>\n";
+        // Rows spilled earlier come first, then whatever is still buffered
+        if (sheet.spill) {
+            std::fflush(sheet.spill);
+            std::rewind(sheet.spill);
+            size_t bytes_read;
+            while ((bytes_read = std::fread(copy_buffer.data(), 1, copy_buffer.size(), sheet.spill)) > 0) {
+                file.write(copy_buffer.data(), static_cast<std::streamsize>(bytes_read));
             }
-            file << "   </Row>\n";
+            std::fclose(sheet.spill);
+            sheet.spill = nullptr;
         }
+        file << sheet.buffer;
+        std::string().swap(sheet.buffer);
         
         file << "  </Table>\n";
         
         // Add worksheet options (freeze header row)
-        if (!rows.empty()) {
+        if (sheet.row_count > 0) {
             file << "  <WorksheetOptions xmlns=\"urn:schemas-microsoft-com:office:excel\">\n";
             file << "   <FreezePanes/>\n";
             file << "   <FrozenNoSplit/>\n";
@@ -162,58 +253,318 @@ bool XMLSpreadsheetWriter::writeFile() {
     }
     
     file << "</Workbook>\n";
-    return true;
+    // Nothing has been flushed yet, so write errors surface here
+    file.flush();
+    return file.good();
 }
 
 bool XMLSpreadsheetWriter::isOpen() const {
     return file.is_open();
 }
 
-// ProgressTracker implementation (unchanged)
-void ProgressTracker::setTotal(int t) {
+// ProgressTracker implementation
+void ProgressTracker::setTotal(int t, uint64_t search_bytes) {
     total = t;
+    total_bytes = search_bytes;
     start_time = std::chrono::steady_clock::now();
 }
 
 void ProgressTracker::increment() {
-    processed++;
+    processed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProgressTracker::addSearched(uint64_t n) {
+    done_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+void ProgressTracker::addFile(uint64_t size) {
+    files.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+ProgressTracker::~ProgressTracker() {
+    if (reporter.joinable()) {
+        stop();
+    }
+}
+
+void ProgressTracker::start(std::chrono::milliseconds interval) {
+    stopping = false;
+    reporter = std::thread(&ProgressTracker::reportLoop, this, interval);
+}
+
+void ProgressTracker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(reporter_mutex);
+        stopping = true;
+    }
+    reporter_cv.notify_all();
+    if (reporter.joinable()) {
+        reporter.join();
+    }
+    
     printProgress();
+    if (total > 0 && processed == total) {
+        std::cout << std::endl << "Processing complete!" << std::endl;
+    }
 }
 
+void ProgressTracker::reportLoop(std::chrono::milliseconds interval) {
+    std::unique_lock<std::mutex> lock(reporter_mutex);
+    while (!reporter_cv.wait_for(lock, interval, [this] { return stopping; })) {
+        printProgress();
+    }
+}
+
+// Only the reporter thread (or stop(), after joining it) prints, so no lock is needed
 void ProgressTracker::printProgress() const {
-    std::lock_guard<std::mutex> lock(print_mutex);
-    
     int proc = processed.load();
     int tot = total.load();
     
     if (tot == 0) return;
     
     auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+    double elapsed = std::chrono::duration<double>(now - start_time).count();
     
     double percentage = (double)proc / tot * 100.0;
     int remaining = tot - proc;
+    uint64_t done = done_bytes.load();
+    uint64_t all = total_bytes.load();
+    uint64_t remaining_bytes = all > done ? all - done : 0;
     
+    // Estimate time remaining from bytes; pair counts say little when file sizes vary widely
     double eta_seconds = 0;
-    if (proc > 0 && elapsed > 0) {
-        double rate = (double)proc / elapsed;
-        eta_seconds = remaining / rate;
+    if (done > 0 && elapsed > 0) {
+        double rate = (double)done / elapsed;
+        eta_seconds = remaining_bytes / rate;
     }
     
     std::cout << "\r[" << std::setw(3) << std::fixed << std::setprecision(1) 
               << percentage << "%] Processed: " << proc << "/" << tot 
               << " | Remaining: " << remaining;
     
+    if (elapsed > 0) {
+        std::cout << " | " << files.load() / elapsed << " files/s"
+                  << " | " << bytes.load() / elapsed / (1024.0 * 1024.0) << " MB/s";
+    }
+    
     if (eta_seconds > 0) {
         int eta_min = (int)(eta_seconds / 60);
         int eta_sec = (int)(eta_seconds) % 60;
         std::cout << " | ETA: " << eta_min << "m " << eta_sec << "s";
     }
     
-    std::cout << std::flush;
+    // Clear what is left of a longer previous line
+    std::cout << "   " << std::flush;
+}
+
+// FileBuffer implementation
+FileBuffer::FileBuffer(const std::string& filepath) {
+    fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file");
+    }
     
-    if (proc == tot) {
-        std::cout << std::endl << "Processing complete!" << std::endl;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0 && st.st_mtime < ::time(nullptr) - SETTLE_SECONDS) {
+            void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, length, MADV_WILLNEED);
+                bytes = static_cast<const char*>(addr);
+                mapped = true;
+            }
+        }
+        if (mapped || length == 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        return; // Otherwise read() preads from fd
+    }
+    
+    // Pipes and special files cannot be read at an offset, so they are read in full
+    char block[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(fd, block, sizeof(block))) > 0) {
+        contents.append(block, static_cast<size_t>(n));
+    }
+    bytes = contents.data();
+    length = contents.size();
+    ::close(fd);
+    fd = -1;
+}
+
+FileBuffer::~FileBuffer() {
+    if (mapped) {
+        ::munmap(const_cast<char*>(bytes), length);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+size_t FileBuffer::size() const {
+    return length;
+}
+
+size_t FileBuffer::read(size_t offset, size_t count, std::vector<char>& storage, const char*& data) const {
+    if (offset >= length) {
+        return 0;
+    }
+    count = std::min(count, length - offset);
+    if (fd < 0) {
+        data = bytes + offset;
+        return count;
+    }
+    
+    storage.resize(count);
+    size_t filled = 0;
+    while (filled < count) {
+        ssize_t got = ::pread(fd, storage.data() + filled, count - filled, static_cast<off_t>(offset + filled));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break; // Shrank since it was opened, or unreadable: scan what there is
+        }
+        filled += static_cast<size_t>(got);
+    }
+    storage.resize(filled);
+    data = storage.data();
+    return filled;
+}
+
+// WorkStealingPool implementation
+WorkStealingPool::WorkStealingPool(size_t num_workers, size_t max_queued) 
+    : max_queued(std::max<size_t>(1, max_queued)) {
+    num_workers = std::max<size_t>(1, num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    
+    // Workers drain every queued task before exiting
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::push(WorkerQueue& queue, Task task) {
+    queued++;
+    {
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    
+    // A worker counts itself as sleeping before it re-checks queued under state_mutex,
+    // so either it sees this task or we see it and wake it
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        work_cv.notify_one();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    outstanding++;
+    
+    if (queued.load() >= max_queued) {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        blocked++;
+        space_cv.wait(lock, [this] { return queued.load() < max_queued; });
+        blocked--;
+    }
+    
+    push(*queues[next_queue++ % queues.size()], std::move(task));
+}
+
+void WorkStealingPool::spawn(size_t worker_index, Task task) {
+    outstanding++;
+    push(*queues[worker_index], std::move(task));
+}
+
+size_t WorkStealingPool::size() const {
+    return workers.size();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    idle_cv.wait(lock, [this] { return outstanding.load() == 0; });
+}
+
+bool WorkStealingPool::waitFor(std::chrono::steady_clock::duration timeout) {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    return idle_cv.wait_for(lock, timeout, [this] { return outstanding.load() == 0; });
+}
+
+bool WorkStealingPool::takeTask(size_t index, Task& task) {
+    // Own queue first, newest task (still warm in cache)
+    {
+        WorkerQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    // Steal the oldest task from another worker
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    while (true) {
+        Task task;
+        
+        if (takeTask(index, task)) {
+            queued--;
+            if (blocked.load() > 0) {
+                std::lock_guard<std::mutex> lock(state_mutex);
+                space_cv.notify_one();
+            }
+            
+            try {
+                task(index);
+            } catch (const std::exception& e) {
+                std::cerr << "Error in worker task: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Unknown error in worker task" << std::endl;
+            }
+            if (--outstanding == 0) {
+                std::lock_guard<std::mutex> lock(state_mutex);
+                idle_cv.notify_all();
+            }
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(state_mutex);
+        sleeping++;
+        work_cv.wait(lock, [this] { return queued.load() > 0 || stopping; });
+        sleeping--;
+        if (queued.load() == 0 && stopping) {
+            return;
+        }
     }
 }
 
@@ -280,7 +631,6 @@ std::vector<ExpressionPattern> AsyncRegexAnalyzer::loadExpressions(const std::st
                         
                         std::regex pattern(pattern_str, flags);
                         patterns.push_back({expr_name, std::move(pattern)});
-                        std::cout << "Loaded expression: " << expr_name << " = " << value << std::endl;
                     } catch (const std::regex_error& e) {
                         std::cerr << "Invalid regex for " << expr_name << ": " << value 
                                  << " Error: " << e.what() << std::endl;
@@ -357,170 +707,333 @@ bool AsyncRegexAnalyzer::isTextFile(const std::string& filepath) {
     }
 }
 
-std::vector<Finding> AsyncRegexAnalyzer::processFileWithExpression(const std::string& filepath, 
-                                                                   const ExpressionPattern& expression) {
-    std::vector<Finding> findings;
-    
+void AsyncRegexAnalyzer::loadFile(const std::string& filepath, uint64_t listed_size, WorkStealingPool& pool, size_t worker_index) {
+    std::shared_ptr<FileJob> job;
     try {
-        std::ifstream file(filepath);
-        if (!file.is_open()) {
-            return findings; // Return empty findings
+        job = std::make_shared<FileJob>(filepath);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << ": " << filepath << std::endl;
+        for (size_t expr_idx = 0; expr_idx < expressions.size(); ++expr_idx) {
+            progress.increment();
+            progress.addSearched(listed_size);
         }
-        
-        const size_t BUFFER_SIZE = 64 * 1024;
-        const size_t WINDOW_SIZE = 32 * 1024;
-        const size_t OVERLAP_SIZE = 16 * 1024;
-        
-        char buffer[BUFFER_SIZE];
-        std::string window;
-        window.reserve(WINDOW_SIZE + OVERLAP_SIZE);
-        int line_number = 1;
-        
-        while (file.read(buffer, BUFFER_SIZE) || file.gcount() > 0) {
-            std::streamsize bytes_read = file.gcount();
-            
-            for (std::streamsize i = 0; i < bytes_read; ++i) {
-                window += buffer[i];
-                
-                if (window.size() >= WINDOW_SIZE + OVERLAP_SIZE) {
-                    std::string segment = window.substr(0, WINDOW_SIZE);
-                    
-                    int segment_line_start = line_number;
-                    for (size_t j = 0; j < segment.size(); ++j) {
-                        if (segment[j] == '\n') {
-                            line_number++;
-                        }
-                    }
-                    
-                    // Process this segment with the expression
-                    try {
-                        std::sregex_iterator regex_start(segment.begin(), segment.end(), expression.pattern);
-                        std::sregex_iterator regex_end;
-                        
-                        for (std::sregex_iterator it = regex_start; it != regex_end; ++it) {
-                            std::smatch match = *it;
-                            
-                            // Calculate line number
-                            std::string before_match = segment.substr(0, match.position());
-                            int match_line = segment_line_start;
-                            for (char c : before_match) {
-                                if (c == '\n') match_line++;
-                            }
-                            
-                            // Extract line containing match
-                            size_t line_start = match.position();
-                            while (line_start > 0 && segment[line_start - 1] != '\n') {
-                                line_start--;
-                            }
-                            
-                            size_t line_end = match.position() + match.length();
-                            while (line_end < segment.size() && segment[line_end] != '\n') {
-                                line_end++;
-                            }
-                            
-                            std::string match_line_content = segment.substr(line_start, line_end - line_start);
-                            
-                            Finding finding;
-                            finding.expression_name = expression.name;
-                            finding.filename = filepath;
-                            finding.line_number = match_line;
-                            finding.actual_match = match.str();
-                            finding.statement = match_line_content;
-                            
-                            findings.push_back(std::move(finding));
-                        }
-                    } catch (const std::regex_error& e) {
-                        // Continue processing
-                    }
-                    
-                    window = window.substr(WINDOW_SIZE - OVERLAP_SIZE);
-                }
+        return;
+    }
+    
+    size_t size = job->buffer.size();
+    progress.addFile(size);
+    size_t chunks = std::max<size_t>(1, (size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    job->chunks = chunks;
+    job->data.resize(chunks);
+    
+    job->results.resize(chunks * expressions.size());
+    job->scanned.assign(chunks, 0);
+    job->carry.assign(expressions.size(), 0);
+    
+    std::lock_guard<std::mutex> lock(job->mutex);
+    queueChunks(job, pool, worker_index);
+}
+
+void AsyncRegexAnalyzer::queueChunks(const std::shared_ptr<FileJob>& job, WorkStealingPool& pool, size_t worker_index) {
+    size_t window = pool.size() * CHUNK_WINDOW;
+    while (job->next_chunk < job->chunkCount() && job->next_chunk < job->merged + window) {
+        size_t chunk = job->next_chunk++;
+        pool.spawn(worker_index, [this, job, chunk, &pool](size_t worker) {
+            runChunk(job, chunk, pool, worker);
+        });
+    }
+}
+
+// Each chunk boundary moves forward to the next line start, so a match within one line
+// is always owned whole by one chunk. One spanning lines is only found if it ends inside
+// the look-ahead, as std::regex cannot report a partial match: an attempt that fails
+// within the look-ahead is dropped even if more text would have completed it. A match
+// whose extent depended on where the look-ahead ended is searched again with a wider
+// one (see readsToEnd). A line running on for
+// CHUNK_SIZE past the nominal boundary is cut there; matches across that cut are found
+// through the look-ahead too.
+size_t AsyncRegexAnalyzer::chunkBoundary(const FileBuffer& buffer, size_t nominal) const {
+    if (nominal == 0 || nominal >= buffer.size()) {
+        return std::min(nominal, buffer.size());
+    }
+    
+    const size_t PROBE_SIZE = 64 * 1024;
+    std::vector<char> storage;
+    for (size_t probe = nominal - 1; probe < nominal - 1 + CHUNK_SIZE; probe += PROBE_SIZE) {
+        const char* data = nullptr;
+        size_t got = buffer.read(probe, PROBE_SIZE, storage, data);
+        const void* newline = std::memchr(data, '\n', got);
+        if (newline) {
+            return probe + static_cast<size_t>(static_cast<const char*>(newline) - data) + 1;
+        }
+        if (got < PROBE_SIZE) {
+            return buffer.size(); // The rest of the file is one line
+        }
+    }
+    return nominal;
+}
+
+void AsyncRegexAnalyzer::loadChunk(FileJob& job, size_t chunk) {
+    ChunkData& data = job.data[chunk];
+    size_t size = job.buffer.size();
+    data.start = chunkBoundary(job.buffer, chunk * CHUNK_SIZE);
+    data.end = (chunk + 1 == job.chunkCount()) ? size : chunkBoundary(job.buffer, (chunk + 1) * CHUNK_SIZE);
+    data.end = std::max(data.end, data.start);
+    
+    // Statement context either side, and the longest look-ahead a search may need
+    size_t context = STATEMENT_CONTEXT;
+    data.origin = data.start - std::min(data.start, context);
+    size_t want = (data.end - data.origin) + MAX_LOOKAHEAD + STATEMENT_CONTEXT;
+    data.length = job.buffer.read(data.origin, want, data.storage, data.bytes);
+    data.at_eof = data.length < want;
+    data.end = std::min(data.end, data.loadedEnd());
+    data.start = std::min(data.start, data.end);
+    
+    const char* end = data.bytes + data.length;
+    for (const char* p = data.bytes; p < end; ++p) {
+        p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!p) {
+            break;
+        }
+        data.newlines.push_back(data.origin + static_cast<size_t>(p - data.bytes));
+    }
+    data.lines = static_cast<size_t>(
+        std::lower_bound(data.newlines.begin(), data.newlines.end(), data.end) - 
+        std::lower_bound(data.newlines.begin(), data.newlines.end(), data.start));
+}
+
+void AsyncRegexAnalyzer::runChunk(const std::shared_ptr<FileJob>& job, size_t chunk, 
+                                  WorkStealingPool& pool, size_t worker_index) {
+    size_t expression_count = expressions.size();
+    {
+        StageTimer timer(match_ns);
+        loadChunk(*job, chunk);
+        const ChunkData& data = job->data[chunk];
+        for (size_t expr_idx = 0; expr_idx < expression_count; ++expr_idx) {
+            job->results[chunk * expression_count + expr_idx] = scanChunk(*job, expressions[expr_idx], chunk, 0);
+            progress.addSearched(data.end - data.start);
+        }
+    }
+    
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->scanned[chunk] = 1;
+    if (!job->merging) {
+        // Merging may rescan, so it runs unlocked; the flag keeps it to one task at a time
+        job->merging = true;
+        while (job->merged < job->chunkCount() && job->scanned[job->merged]) {
+            size_t next = job->merged;
+            lock.unlock();
+            {
+                StageTimer timer(match_ns);
+                mergeChunk(*job, next, worker_index);
             }
+            lock.lock();
+            job->merged++;
         }
-        
-        // Process remaining data in window
-        if (!window.empty()) {
-            for (char c : window) {
-                if (c == '\n') {
-                    line_number++;
-                }
+        job->merging = false;
+    }
+    queueChunks(job, pool, worker_index);
+}
+
+// Byte iterator that records the furthest byte std::regex reads through it
+class ReachIterator {
+private:
+    const char* position = nullptr;
+    const char** reach = nullptr;
+    
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+    
+    ReachIterator() = default;
+    ReachIterator(const char* position, const char** reach) : position(position), reach(reach) {}
+    
+    reference operator*() const {
+        if (position >= *reach) {
+            *reach = position + 1;
+        }
+        return *position;
+    }
+    ReachIterator& operator++() { ++position; return *this; }
+    ReachIterator operator++(int) { ReachIterator before = *this; ++position; return before; }
+    ReachIterator& operator--() { --position; return *this; }
+    ReachIterator operator--(int) { ReachIterator before = *this; --position; return before; }
+    bool operator==(const ReachIterator& other) const { return position == other.position; }
+    bool operator!=(const ReachIterator& other) const { return position != other.position; }
+};
+
+// Whether the match std::regex chose at begin depended on the text running out at end:
+// the attempt is repeated there, anchored, and reports whether it read the last byte.
+// If it did, more text could have let a longer alternative win.
+static bool readsToEnd(const char* begin, const char* end, const std::regex& pattern, 
+                       std::regex_constants::match_flag_type flags) {
+    const char* reach = begin;
+    std::match_results<ReachIterator> match;
+    std::regex_search(ReachIterator(begin, &reach), ReachIterator(end, &reach), match, pattern, 
+                      flags | std::regex_constants::match_continuous);
+    return reach >= end;
+}
+
+ChunkResult AsyncRegexAnalyzer::scanChunk(const FileJob& job, const ExpressionPattern& expression, 
+                                          size_t chunk, size_t from) {
+    ChunkResult result;
+    const ChunkData& data = job.data[chunk];
+    size_t chunk_start = data.start;
+    size_t chunk_end = data.end;
+    size_t lookahead = LOOKAHEAD_SIZE;
+    
+    size_t pos = std::max(from, chunk_start);
+    
+    try {
+        while (pos < chunk_end) {
+            size_t limit = std::min(data.loadedEnd(), chunk_end + lookahead);
+            bool at_file_end = data.at_eof && limit == data.loadedEnd();
+            auto flags = (pos > 0) ? std::regex_constants::match_prev_avail 
+                                   : std::regex_constants::match_default;
+            if (!at_file_end) {
+                // The look-ahead end is not the end of the file: $ and \b must not match there
+                flags |= std::regex_constants::match_not_eol | std::regex_constants::match_not_eow;
             }
+            std::cregex_iterator regex_start(data.at(pos), data.at(limit), expression.pattern, flags);
+            std::cregex_iterator regex_end;
+            bool restart = false;
             
-            try {
-                std::sregex_iterator regex_start(window.begin(), window.end(), expression.pattern);
-                std::sregex_iterator regex_end;
+            for (std::cregex_iterator it = regex_start; it != regex_end; ++it) {
+                const std::cmatch& match = *it;
+                size_t match_start = pos + static_cast<size_t>(match.position());
+                size_t match_end = match_start + static_cast<size_t>(match.length());
                 
-                for (std::sregex_iterator it = regex_start; it != regex_end; ++it) {
-                    std::smatch match = *it;
-                    
-                    std::string before_match = window.substr(0, match.position());
-                    int match_line = line_number - std::count(window.begin(), window.end(), '\n');
-                    for (char c : before_match) {
-                        if (c == '\n') match_line++;
-                    }
-                    
-                    size_t line_start = match.position();
-                    while (line_start > 0 && window[line_start - 1] != '\n') {
-                        line_start--;
-                    }
-                    
-                    size_t line_end = match.position() + match.length();
-                    while (line_end < window.size() && window[line_end] != '\n') {
-                        line_end++;
+                if (match_start >= chunk_end) {
+                    break; // Belongs to the next chunk
+                }
+                
+                // May run past the look-ahead, or have settled for a shorter alternative
+                // because the text ran out there: search again from its start with a wider
+                // one, which drops it if it does not match there
+                auto match_flags = (match_start > 0) ? flags | std::regex_constants::match_prev_avail : flags;
+                if (!at_file_end && (match_end >= limit || 
+                                     readsToEnd(data.at(match_start), data.at(limit), expression.pattern, match_flags))) {
+                    if (lookahead < MAX_LOOKAHEAD) {
+                        lookahead *= 2;
+                        pos = match_start;
+                        restart = true;
+                        break;
                     }
                     
-                    std::string match_line_content = window.substr(line_start, line_end - line_start);
-                    
-                    Finding finding;
-                    finding.expression_name = expression.name;
-                    finding.filename = filepath;
-                    finding.line_number = match_line;
-                    finding.actual_match = match.str();
-                    finding.statement = match_line_content;
-                    
-                    findings.push_back(std::move(finding));
+                    // Still unresolved at MAX_LOOKAHEAD: report it as too long rather than
+                    // guess at its extent, and claim the rest of its line so the next chunk does not
+                    // report the tail as a match of its own
+                    auto newline = std::lower_bound(data.newlines.begin(), data.newlines.end(), limit);
+                    result.too_long.push_back(match_start);
+                    result.last_end = (newline == data.newlines.end()) ? data.loadedEnd() : *newline;
+                    break;
                 }
-            } catch (const std::regex_error& e) {
-                // Continue
+                std::string match_text = match.str();
+                
+                // Line containing the match, clipped to STATEMENT_CONTEXT bytes either side of
+                // it. The line number counts from the chunk start; merging makes it absolute.
+                auto first_line = std::lower_bound(data.newlines.begin(), data.newlines.end(), chunk_start);
+                auto newline = std::lower_bound(first_line, data.newlines.end(), match_start);
+                size_t line_number = static_cast<size_t>(newline - first_line) + 1;
+                size_t line_start = (newline == data.newlines.begin()) ? data.origin : *(newline - 1) + 1;
+                newline = std::lower_bound(newline, data.newlines.end(), match_end);
+                size_t line_end = (newline == data.newlines.end()) ? data.loadedEnd() : *newline;
+                line_start = std::max(line_start, match_start > STATEMENT_CONTEXT ? match_start - STATEMENT_CONTEXT : 0);
+                line_end = std::min(line_end, match_end + STATEMENT_CONTEXT);
+                
+                Finding finding;
+                finding.expression_name = expression.name;
+                finding.filename = job.filepath;
+                finding.line_number = static_cast<int>(line_number);
+                finding.actual_match = std::move(match_text);
+                finding.statement.assign(data.at(line_start), data.at(line_end));
+                result.findings.push_back(std::move(finding));
+                
+                if (result.first_start == std::string::npos) {
+                    result.first_start = match_start;
+                }
+                result.last_end = match_end;
+            }
+            
+            if (!restart) {
+                break;
             }
         }
-        
     } catch (const std::exception& e) {
-        std::cerr << "Error processing file " << filepath << " with expression " 
+        std::cerr << "Error processing file " << job.filepath << " with expression " 
                   << expression.name << ": " << e.what() << std::endl;
     }
     
-    return findings;
+    return result;
 }
 
-std::future<std::vector<Finding>> AsyncRegexAnalyzer::processFileAsync(const std::string& filepath, 
-                                                                       const ExpressionPattern& expression) {
-    return std::async(std::launch::async, [this, filepath, expression]() {
-        auto findings = processFileWithExpression(filepath, expression);
-        progress.increment(); // Increment after each file-expression pair completes
-        return findings;
-    });
+void AsyncRegexAnalyzer::mergeChunk(FileJob& job, size_t chunk, size_t worker_index) {
+    std::vector<Finding>& findings = worker_findings[worker_index];
+    size_t expression_count = expressions.size();
+    
+    for (size_t expr_idx = 0; expr_idx < expression_count; ++expr_idx) {
+        ChunkResult& result = job.results[chunk * expression_count + expr_idx];
+        size_t& carry = job.carry[expr_idx];
+        
+        // A match from an earlier chunk ran into this one; matches that overlap it are
+        // not real, so search this chunk again from where that match ended
+        if (result.first_start != std::string::npos && result.first_start < carry) {
+            result = scanChunk(job, expressions[expr_idx], chunk, carry);
+        }
+        carry = std::max(carry, result.last_end);
+        
+        for (size_t match_start : result.too_long) {
+            std::cerr << "Warning: " << expressions[expr_idx].name << " in " << job.filepath 
+                      << " from byte " << match_start << ": match runs past the " << MAX_LOOKAHEAD 
+                      << "-byte look-ahead (not reported)" << std::endl;
+        }
+        for (Finding& finding : result.findings) {
+            finding.line_number += static_cast<int>(job.lines_before);
+        }
+        findings.insert(findings.end(), 
+                        std::make_move_iterator(result.findings.begin()),
+                        std::make_move_iterator(result.findings.end()));
+        result = ChunkResult();
+        
+        if (chunk + 1 == job.chunkCount()) {
+            progress.increment(); // One file-expression pair complete
+        }
+    }
+    
+    // Later chunks never look back, so this chunk's bytes can go
+    job.lines_before += job.data[chunk].lines;
+    job.data[chunk] = ChunkData();
 }
 
-std::vector<std::string> AsyncRegexAnalyzer::findTextFiles(const std::string& directory) {
-    std::vector<std::string> text_files;
+// Returns the text files under directory with their sizes, largest first, so big files
+// are not left to run alone at the end of the scan
+std::vector<std::pair<uint64_t, std::string>> AsyncRegexAnalyzer::findTextFiles(const std::string& directory) {
+    std::vector<std::pair<uint64_t, std::string>> sized_files;
     
     try {
         if (!std::filesystem::exists(directory)) {
             std::cerr << "Error: Directory does not exist: " << directory << std::endl;
-            return text_files;
+            return sized_files;
         }
         
         if (!std::filesystem::is_directory(directory)) {
             std::cerr << "Error: Path is not a directory: " << directory << std::endl;
-            return text_files;
+            return sized_files;
         }
         
         for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
             try {
                 if (entry.is_regular_file()) {
-                    if (isTextFile(entry.path().string())) {
-                        text_files.push_back(entry.path().string());
+                    bool is_text;
+                    {
+                        StageTimer timer(detect_ns);
+                        is_text = isTextFile(entry.path().string());
+                    }
+                    if (is_text) {
+                        sized_files.emplace_back(entry.file_size(), entry.path().string());
                     }
                 }
             } catch (const std::filesystem::filesystem_error& e) {
@@ -533,69 +1046,17 @@ std::vector<std::string> AsyncRegexAnalyzer::findTextFiles(const std::string& di
         std::cerr << "Error accessing directory: " << e.what() << std::endl;
     }
     
-    return text_files;
-}
-
-void AsyncRegexAnalyzer::collectCompletedFutures() {
-    std::lock_guard<std::mutex> lock(futures_mutex);
-    
-    // Check for completed futures and collect their results
-    auto it = file_futures.begin();
-    while (it != file_futures.end()) {
-        if (it->wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
-            try {
-                auto findings = it->get();
-                if (!findings.empty()) {
-                    std::lock_guard<std::mutex> findings_lock(findings_mutex);
-                    all_findings.insert(all_findings.end(), 
-                                       std::make_move_iterator(findings.begin()),
-                                       std::make_move_iterator(findings.end()));
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Error collecting future result: " << e.what() << std::endl;
-            }
-            it = file_futures.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
-void AsyncRegexAnalyzer::workerThread() {
-    while (!shutdown.load()) {
-        WorkItem work_item("", 0);
-        
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            queue_cv.wait(lock, [this] { return !work_queue.empty() || shutdown.load(); });
-            
-            if (shutdown.load() && work_queue.empty()) {
-                break;
-            }
-            
-            if (!work_queue.empty()) {
-                work_item = work_queue.front();
-                work_queue.pop();
-            } else {
-                continue;
-            }
-        }
-        
-        if (!work_item.filepath.empty() && work_item.expression_index < expressions.size()) {
-            // Launch async processing for this file-expression pair
-            auto future = processFileAsync(work_item.filepath, expressions[work_item.expression_index]);
-            
-            std::lock_guard<std::mutex> futures_lock(futures_mutex);
-            file_futures.push_back(std::move(future));
-        }
-        
-        // Periodically collect completed futures
-        collectCompletedFutures();
-    }
+    std::stable_sort(sized_files.begin(), sized_files.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
+    return sized_files;
 }
 
 void AsyncRegexAnalyzer::analyze(const std::string& directory, const std::string& expressions_file, 
                                 const std::string& output_file, int num_threads) {
+    auto analyze_start = std::chrono::steady_clock::now();
+    stage_timings = StageTimings();
+    detect_ns = 0;
+    match_ns = 0;
     
     std::cout << "Loading expressions from: " << expressions_file << std::endl;
     expressions = loadExpressions(expressions_file);
@@ -607,7 +1068,10 @@ void AsyncRegexAnalyzer::analyze(const std::string& directory, const std::string
     std::cout << "Loaded " << expressions.size() << " expressions" << std::endl;
     std::cout << "Scanning directory: " << directory << std::endl;
     
+    auto walk_start = std::chrono::steady_clock::now();
     auto text_files = findTextFiles(directory);
+    stage_timings.walk_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - walk_start).count() - 
+                                 detect_ns / 1e9;
     std::cout << "Found " << text_files.size() << " text files" << std::endl;
     
     if (text_files.empty()) {
@@ -615,76 +1079,62 @@ void AsyncRegexAnalyzer::analyze(const std::string& directory, const std::string
         return;
     }
     
-    // Create work items for each file-expression combination
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        for (const auto& filepath : text_files) {
-            for (size_t expr_idx = 0; expr_idx < expressions.size(); ++expr_idx) {
-                work_queue.emplace(filepath, expr_idx);
-            }
-        }
+    // Every file is scanned once per expression
+    uint64_t text_bytes = 0;
+    for (const auto& file : text_files) {
+        text_bytes += file.first;
     }
-    
     int total_work_items = text_files.size() * expressions.size();
-    progress.setTotal(total_work_items);
+    progress.setTotal(total_work_items, text_bytes * expressions.size());
+    progress.start();
+    
     std::cout << "Created " << total_work_items << " work items (" 
               << text_files.size() << " files × " << expressions.size() << " expressions)" << std::endl;
     std::cout << "Starting analysis with " << num_threads << " threads..." << std::endl;
     
-    // Launch worker threads
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back(&AsyncRegexAnalyzer::workerThread, this);
-    }
-    
-    // Monitor progress and collect results
-    auto start_time = std::chrono::steady_clock::now();
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        
-        // Collect completed futures
-        collectCompletedFutures();
-        
-        // Check if all work is done
-        bool work_queue_empty = false;
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            work_queue_empty = work_queue.empty();
-        }
-        
-        bool futures_empty = false;
-        {
-            std::lock_guard<std::mutex> lock(futures_mutex);
-            futures_empty = file_futures.empty();
-        }
+    {
+        // num_threads bounds concurrency; submit() blocks while the queues are full
+        size_t workers = static_cast<size_t>(std::max(1, num_threads));
+        WorkStealingPool pool(workers, workers * 16);
+        worker_findings.assign(pool.size(), std::vector<Finding>());
         
-        if (work_queue_empty && futures_empty) {
-            break;
+        // One task per file; each file is read once and scanned as a window of chunk tasks
+        for (const auto& file : text_files) {
+            pool.submit([this, &pool, file](size_t worker_index) {
+                loadFile(file.second, file.first, pool, worker_index);
+            });
         }
         
-        // Timeout check (prevent infinite wait)
-        auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(
-            std::chrono::steady_clock::now() - start_time).count();
-        if (elapsed > 60) { // 60 minute timeout
+        // Woken by the last task to finish rather than by polling
+        if (!pool.waitFor(std::chrono::minutes(60))) {
             std::cout << "\nWarning: Processing taking longer than expected. Checking for stuck threads..." << std::endl;
+            pool.wait();
         }
-    }
+    } // Pool destructor stops and joins the workers
+    progress.stop();
     
-    // Signal shutdown and wait for threads
-    shutdown.store(true);
-    queue_cv.notify_all();
-    
-    for (auto& thread : threads) {
-        thread.join();
+    // Gather the per-worker buffers; no task is running any more
+    for (auto& findings : worker_findings) {
+        all_findings.insert(all_findings.end(), 
+                           std::make_move_iterator(findings.begin()),
+                           std::make_move_iterator(findings.end()));
     }
-    
-    // Final collection of any remaining futures
-    collectCompletedFutures();
+    worker_findings.clear();
     
     std::cout << std::endl << "Analysis complete. Found " << all_findings.size() << " matches" << std::endl;
     std::cout << "Writing results to: " << output_file << std::endl;
     
+    auto write_start = std::chrono::steady_clock::now();
     writeResults(output_file);
+    auto analyze_end = std::chrono::steady_clock::now();
+    
+    stage_timings.total_seconds = std::chrono::duration<double>(analyze_end - analyze_start).count();
+    stage_timings.detect_seconds = detect_ns / 1e9;
+    stage_timings.match_seconds = match_ns / 1e9;
+    stage_timings.write_seconds = std::chrono::duration<double>(analyze_end - write_start).count();
+    stage_timings.files = text_files.size();
+    stage_timings.bytes = progress.byteCount();
+    stage_timings.findings = all_findings.size();
 }
 
 void AsyncRegexAnalyzer::writeResults(const std::string& output_filename) {
@@ -714,10 +1164,10 @@ void AsyncRegexAnalyzer::writeXLSXResults(const std::string& output_filename) {
     format_set_text_wrap(cell_format);
     
     // Group findings by expression
-    std::map<std::string, std::vector<Finding>> grouped_findings;
+    std::map<std::string, std::vector<const Finding*>> grouped_findings;
     
     for (const auto& finding : all_findings) {
-        grouped_findings[finding.expression_name].push_back(finding);
+        grouped_findings[finding.expression_name].push_back(&finding);
     }
     
     // Create worksheet for each expression
@@ -760,15 +1210,15 @@ void AsyncRegexAnalyzer::writeXLSXResults(const std::string& output_filename) {
         
         // Write findings
         int row = 1;
-        for (const auto& finding : findings) {
-            worksheet_write_string(worksheet, row, 0, finding.actual_match.c_str(), cell_format);
-            worksheet_write_string(worksheet, row, 1, finding.filename.c_str(), cell_format);
-            worksheet_write_number(worksheet, row, 2, finding.line_number, cell_format);
+        for (const Finding* finding : findings) {
+            worksheet_write_string(worksheet, row, 0, finding->actual_match.c_str(), cell_format);
+            worksheet_write_string(worksheet, row, 1, finding->filename.c_str(), cell_format);
+            worksheet_write_number(worksheet, row, 2, finding->line_number, cell_format);
             worksheet_write_string(worksheet, row, 3, "", cell_format); // Comments (blank)
             worksheet_write_string(worksheet, row, 4, "", cell_format); // Ease (blank)
             worksheet_write_string(worksheet, row, 5, "", cell_format); // Significance (blank)
             worksheet_write_string(worksheet, row, 6, "", cell_format); // Risk (blank)
-            worksheet_write_string(worksheet, row, 7, finding.statement.c_str(), cell_format);
+            worksheet_write_string(worksheet, row, 7, finding->statement.c_str(), cell_format);
             row++;
         }
         
@@ -845,50 +1295,46 @@ void AsyncRegexAnalyzer::writeXMLSpreadsheetResults(const std::string& output_fi
         throw std::runtime_error("Failed to create XML spreadsheet: " + xml_filename);
     }
     
-    // Group findings by expression
-    std::map<std::string, std::vector<Finding>> grouped_findings;
+    auto addHeader = [&writer](const std::string& sheet_name) {
+        writer.addRow(sheet_name, {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
+    };
     
-    for (const auto& finding : all_findings) {
-        grouped_findings[finding.expression_name].push_back(finding);
+    // Stream each finding into its expression's sheet and into Summary in one pass;
+    // a sheet is created when its expression first appears
+    const std::string summary_name = "Summary";
+    std::map<std::string, size_t> sheet_counts;
+    if (!all_findings.empty()) {
+        writer.addWorksheet(summary_name);
+        addHeader(summary_name);
     }
     
-    // Create worksheet for each expression
-    for (const auto& [expr_name, findings] : grouped_findings) {
-        writer.addWorksheet(expr_name);
-        
-        // Add header row
-        writer.addRow(expr_name, {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
+    for (const auto& finding : all_findings) {
+        auto sheet = sheet_counts.emplace(finding.expression_name, 0);
+        if (sheet.second) {
+            writer.addWorksheet(finding.expression_name);
+            addHeader(finding.expression_name);
+        }
+        sheet.first->second++;
         
-        // Add findings
-        for (const auto& finding : findings) {
-            writer.addRow(expr_name, {
-                finding.actual_match,
+        // Rows are rendered straight from the finding; the line number is a typed Number cell
+        for (const std::string* sheet_name : {&finding.expression_name, &summary_name}) {
+            writer.addRow(*sheet_name, {
+                finding.actual_match,        // Actual regex match
                 finding.filename,
-                std::to_string(finding.line_number),
-                "", "", "", "", // Comments, Ease, Significance, Risk (blank)
-                finding.statement
+                finding.line_number,
+                "", // Comments (blank)
+                "", // Ease (blank)
+                "", // Significance (blank)
+                "", // Risk (blank)
+                finding.statement            // Full line
             });
         }
-        
-        std::cout << "Created sheet: " << expr_name << " with " << findings.size() << " findings" << std::endl;
     }
     
-    // Create summary worksheet
+    for (const auto& [expr_name, count] : sheet_counts) {
+        std::cout << "Created sheet: " << expr_name << " with " << count << " findings" << std::endl;
+    }
     if (!all_findings.empty()) {
-        writer.addWorksheet("Summary");
-        
-        writer.addRow("Summary", {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
-        
-        for (const auto& finding : all_findings) {
-            writer.addRow("Summary", {
-                finding.actual_match,
-                finding.filename,
-                std::to_string(finding.line_number),
-                "", "", "", "",
-                finding.statement
-            });
-        }
-        
         std::cout << "Created Summary sheet with " << all_findings.size() << " total findings" << std::endl;
     }
     
@@ -913,6 +1359,7 @@ void printUsage(const char* program_name) {
     std::cout << "expression.ip=\\b(?:[0-9]{1,3}\\.){3}[0-9]{1,3}\\b" << std::endl;
 }
 
+#ifndef WHISTLE_NO_MAIN
 int main(int argc, char* argv[]) {
     if (argc < 4 || argc > 5) {
         printUsage(argv[0]);
@@ -942,3 +1389,4 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 }
+#endif // WHISTLE_NO_MAIN
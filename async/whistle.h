@@ -16,8 +16,23 @@
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <charconv>
+#include <string_view>
+#include <initializer_list>
 #include <condition_variable>
-#include <future>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Check for libxlsxwriter availability
 #ifdef HAVE_XLSXWRITER
@@ -27,21 +42,53 @@
 #define USE_XLSX 0
 #endif
 
-// XML Spreadsheet 2003 writer (fallback when XLSX not available)
+// One spreadsheet cell. Text is referenced, not copied, so it only has to stay alive
+// for the addRow() call; integers are written as Number cells.
+struct SpreadsheetCell {
+    std::string_view text;
+    long long number = 0;
+    bool is_number = false;
+    
+    SpreadsheetCell(const char* value) : text(value) {}
+    SpreadsheetCell(const std::string& value) : text(value) {}
+    SpreadsheetCell(int value) : number(value), is_number(true) {}
+};
+
+// XML Spreadsheet 2003 writer (fallback when XLSX not available). Rows are rendered
+// as they are added and each worksheet spills to an anonymous temp file once the
+// buffered rows of all sheets exceed buffer_limit, so memory does not grow with the
+// row count. writeFile() splices the sheets together.
 class XMLSpreadsheetWriter {
 private:
+    struct Worksheet {
+        std::string buffer;           // Rendered rows not yet spilled
+        std::FILE* spill = nullptr;   // Rendered rows already spilled, in order
+        size_t row_count = 0;
+    };
+    
+    std::vector<char> file_buffer;    // Large user-space buffer behind the ofstream
     std::ofstream file;
-    std::map<std::string, std::vector<std::vector<std::string>>> worksheets;
+    std::map<std::string, Worksheet> worksheets;
+    size_t buffer_limit;
+    size_t buffered_bytes = 0;
     
     std::string escapeXML(const std::string& text);
+    static void appendEscaped(std::string& out, std::string_view text);
     std::string cleanSheetName(const std::string& name);
+    void spillWorksheets();
     
 public:
-    XMLSpreadsheetWriter(const std::string& filename);
+    static const size_t DEFAULT_BUFFER_LIMIT = 16 * 1024 * 1024;
+    static const size_t FILE_BUFFER_SIZE = 1024 * 1024;
+    
+    XMLSpreadsheetWriter(const std::string& filename, size_t buffer_limit = DEFAULT_BUFFER_LIMIT);
     ~XMLSpreadsheetWriter();
     
+    XMLSpreadsheetWriter(const XMLSpreadsheetWriter&) = delete;
+    XMLSpreadsheetWriter& operator=(const XMLSpreadsheetWriter&) = delete;
+    
     void addWorksheet(const std::string& name);
-    void addRow(const std::string& worksheet_name, const std::vector<std::string>& row);
+    void addRow(const std::string& worksheet_name, std::initializer_list<SpreadsheetCell> row);
     bool writeFile();
     bool isOpen() const;
 };
@@ -59,66 +106,246 @@ struct ExpressionPattern {
     std::regex pattern;
 };
 
-// Work item representing a file-expression pair
-struct WorkItem {
+// Read-only access to one file, shared by every task that scans it. Settled regular
+// files are memory-mapped. Files written in the last SETTLE_SECONDS are read with
+// pread() a chunk at a time instead, since a writer truncating a mapped file
+// (copytruncate log rotation) would fault the scan with SIGBUS. Anything else (pipes,
+// special files) is read into memory. size() is fixed when the file is opened.
+class FileBuffer {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    int fd = -1;                // Open while reads go through pread()
+    std::string contents;
+    
+public:
+    static constexpr time_t SETTLE_SECONDS = 300;
+    
+    explicit FileBuffer(const std::string& filepath);
+    ~FileBuffer();
+    
+    FileBuffer(const FileBuffer&) = delete;
+    FileBuffer& operator=(const FileBuffer&) = delete;
+    
+    size_t size() const;
+    
+    // Points data at bytes [offset, offset + count), in the mapping or read into storage,
+    // and returns how many of them there are; fewer if the file has since shrunk
+    size_t read(size_t offset, size_t count, std::vector<char>& storage, const char*& data) const;
+};
+
+// The bytes one chunk task scans: the chunk itself, STATEMENT_CONTEXT bytes before it
+// and the maximum look-ahead plus STATEMENT_CONTEXT after it. Offsets are file offsets.
+struct ChunkData {
+    size_t start = 0;              // The chunk owns [start, end)
+    size_t end = 0;
+    size_t origin = 0;             // File offset of bytes[0]
+    size_t length = 0;
+    bool at_eof = false;           // bytes run to the end of the file
+    const char* bytes = nullptr;
+    std::vector<char> storage;     // Backs bytes unless the file is mapped
+    std::vector<size_t> newlines;  // Offset of every '\n' in the bytes, in order
+    size_t lines = 0;              // Newlines in [start, end)
+    
+    const char* at(size_t offset) const { return bytes + (offset - origin); }
+    size_t loadedEnd() const { return origin + length; }
+};
+
+// Matches of one expression that start inside one chunk of a file
+struct ChunkResult {
+    std::vector<Finding> findings;
+    std::vector<size_t> too_long;            // Starts of matches that ran past MAX_LOOKAHEAD
+    size_t first_start = std::string::npos;  // Offset of the first match, npos if none
+    size_t last_end = 0;                     // End of the last match, or of the bytes a too-long match claims
+};
+
+// An opened file scanned as one task per chunk, each running every expression. Only a
+// window of chunks is queued or waiting to be merged at a time, so at most that many
+// chunks' bytes are held; each finished chunk is merged in file order by whichever
+// task finds it next in line, and then queues the chunks the window has room for.
+struct FileJob {
     std::string filepath;
-    size_t expression_index;
+    FileBuffer buffer;
+    size_t chunks = 0;
+    std::vector<ChunkData> data;           // Indexed by chunk; released once merged
+    std::vector<ChunkResult> results;      // Indexed [chunk * expressions + expression]
     
-    WorkItem(const std::string& path, size_t expr_idx) 
-        : filepath(path), expression_index(expr_idx) {}
+    std::mutex mutex;                      // Guards the fields below
+    std::vector<char> scanned;             // Chunks whose results are ready to merge
+    std::vector<size_t> carry;             // Per expression: end of the last accepted match
+    size_t next_chunk = 0;                 // First chunk not yet queued
+    size_t merged = 0;                     // Chunks merged so far
+    size_t lines_before = 0;               // Newlines before the next chunk to merge
+    bool merging = false;                  // A task is merging; others just leave their results
+    
+    explicit FileJob(const std::string& path) : filepath(path), buffer(path) {}
+    size_t chunkCount() const { return chunks; }
 };
 
+// Progress counters that tasks bump without locking. While running, a reporter thread
+// samples them a few times per second and redraws a single status line.
 class ProgressTracker {
 private:
-    std::atomic<int> processed{0};
+    std::atomic<int> processed{0};       // File-expression pairs done
     std::atomic<int> total{0};
+    std::atomic<uint64_t> files{0};      // Files read
+    std::atomic<uint64_t> bytes{0};      // Bytes read
+    std::atomic<uint64_t> total_bytes{0};  // Bytes to search: every file once per expression
+    std::atomic<uint64_t> done_bytes{0};   // Bytes searched so far
     std::chrono::steady_clock::time_point start_time;
-    mutable std::mutex print_mutex;
+    
+    std::thread reporter;
+    std::mutex reporter_mutex;
+    std::condition_variable reporter_cv;
+    bool stopping = false;
+    
+    void reportLoop(std::chrono::milliseconds interval);
+    void printProgress() const;
     
 public:
-    void setTotal(int t);
+    static constexpr std::chrono::milliseconds REPORT_INTERVAL{250};
+    
+    ~ProgressTracker();
+    
+    void setTotal(int t, uint64_t search_bytes);
     void increment();
-    void printProgress() const;
+    void addSearched(uint64_t n);
+    void addFile(uint64_t size);
+    uint64_t byteCount() const { return bytes.load(); }
+    
+    void start(std::chrono::milliseconds interval = REPORT_INTERVAL);
+    void stop();               // Stops the reporter and prints the final status
+};
+
+// Per-stage timings of the last analyze() run, for benchmarking. Stages that run on
+// several workers at once are summed over the workers, so they can exceed the wall time.
+struct StageTimings {
+    double total_seconds = 0;    // Wall time of analyze()
+    double walk_seconds = 0;     // Directory traversal (wall)
+    double detect_seconds = 0;   // Text/binary classification
+    double match_seconds = 0;    // Regex matching and chunk merging (summed)
+    double write_seconds = 0;    // Producing the output
+    uint64_t files = 0;          // Text files scanned
+    uint64_t bytes = 0;          // Bytes scanned
+    uint64_t findings = 0;
+};
+
+// Adds its own lifetime, in nanoseconds, to a shared counter
+class StageTimer {
+private:
+    std::atomic<uint64_t>& total_ns;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+public:
+    explicit StageTimer(std::atomic<uint64_t>& total_ns) : total_ns(total_ns) {}
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        total_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+// Fixed-size thread pool. Each worker owns a deque: it pops its own tasks from the
+// back and, when empty, steals from the front of the other workers' deques.
+// submit() blocks once max_queued tasks are waiting, bounding queue memory.
+// Queueing and taking tasks only touch the deques and atomic counters; state_mutex
+// is taken just to put an idle worker or a blocked submitter to sleep or wake it.
+class WorkStealingPool {
+public:
+    using Task = std::function<void(size_t worker_index)>;
+    
+private:
+    struct WorkerQueue {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+    
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex state_mutex;
+    std::condition_variable work_cv;    // Signalled when a task is queued or on stop
+    std::condition_variable space_cv;   // Signalled when a queued task is taken
+    std::condition_variable idle_cv;    // Signalled when the last outstanding task finishes
+    std::atomic<size_t> queued{0};      // Counted before the push, so never below the deques' total
+    size_t max_queued;
+    std::atomic<size_t> next_queue{0};
+    std::atomic<size_t> sleeping{0};    // Workers waiting on work_cv
+    std::atomic<size_t> blocked{0};     // Submitters waiting on space_cv
+    bool stopping = false;
+    std::atomic<size_t> outstanding{0}; // Queued plus running tasks
+    
+    void push(WorkerQueue& queue, Task task);
+    bool takeTask(size_t index, Task& task);
+    void workerLoop(size_t index);
+    
+public:
+    WorkStealingPool(size_t num_workers, size_t max_queued);
+    ~WorkStealingPool();
+    
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    void submit(Task task);
+    // Queues a follow-up task from inside a running task onto that worker's own deque.
+    // Never blocks, so fanning out cannot deadlock against the submit() bound.
+    void spawn(size_t worker_index, Task task);
+    size_t size() const;
+    
+    // Block until every submitted and spawned task has finished
+    void wait();
+    bool waitFor(std::chrono::steady_clock::duration timeout);
 };
 
 class AsyncRegexAnalyzer {
 private:
     std::vector<ExpressionPattern> expressions;
     
-    // Thread-safe work queue
-    std::queue<WorkItem> work_queue;
-    std::mutex queue_mutex;
-    std::condition_variable queue_cv;
-    std::atomic<bool> shutdown{false};
-    
-    // Thread-safe findings storage
-    std::mutex findings_mutex;
+    // Findings are buffered per pool worker and gathered once the pool is idle
+    std::vector<std::vector<Finding>> worker_findings;
     std::vector<Finding> all_findings;
     
     ProgressTracker progress;
-    
-    // Async file processing
-    std::vector<std::future<std::vector<Finding>>> file_futures;
-    std::mutex futures_mutex;
+    StageTimings stage_timings;
+    std::atomic<uint64_t> detect_ns{0};
+    std::atomic<uint64_t> match_ns{0};
     
     std::vector<ExpressionPattern> loadExpressions(const std::string& filename);
     bool isTextFile(const std::string& filepath);
     
-    // Process a single file with a single expression
-    std::vector<Finding> processFileWithExpression(const std::string& filepath, 
-                                                   const ExpressionPattern& expression);
+    static const size_t CHUNK_SIZE = 1024 * 1024;      // Files larger than this are split across tasks at line starts
+    static const size_t LOOKAHEAD_SIZE = 4 * 1024;     // Bytes searched past a chunk for matches that straddle it
+    static const size_t MAX_LOOKAHEAD = 16 * 1024;     // Look-ahead cap; std::regex recurses per matched byte,
+                                                       // so this stays well inside a worker's stack
+    static const size_t STATEMENT_CONTEXT = 16 * 1024; // Bytes of a long line kept either side of a match
+    static const size_t CHUNK_WINDOW = 2;              // Chunks of one file queued or unmerged, per worker
+    
+    // Opens a file and queues the first window of its chunk tasks
+    void loadFile(const std::string& filepath, uint64_t listed_size, WorkStealingPool& pool, size_t worker_index);
+    
+    // Queues chunk tasks while the file's window has room; caller holds job.mutex
+    void queueChunks(const std::shared_ptr<FileJob>& job, WorkStealingPool& pool, size_t worker_index);
+    
+    // Offset of the first line start at or after nominal, looking at most CHUNK_SIZE
+    // bytes ahead; nominal itself if that finds no newline
+    size_t chunkBoundary(const FileBuffer& buffer, size_t nominal) const;
+    
+    // Reads a chunk's bytes and indexes their newlines
+    void loadChunk(FileJob& job, size_t chunk);
     
-    // Async file processing that returns a future
-    std::future<std::vector<Finding>> processFileAsync(const std::string& filepath, 
-                                                       const ExpressionPattern& expression);
+    // Scans one chunk with every expression, then merges whatever is next in line
+    void runChunk(const std::shared_ptr<FileJob>& job, size_t chunk, WorkStealingPool& pool, size_t worker_index);
     
-    std::vector<std::string> findTextFiles(const std::string& directory);
+    // Finds the matches of one expression starting in [from, chunk end)
+    ChunkResult scanChunk(const FileJob& job, const ExpressionPattern& expression, 
+                          size_t chunk, size_t from);
     
-    // Worker thread that processes work items from queue
-    void workerThread();
+    // Joins one chunk's results onto the chunks before it and publishes them
+    void mergeChunk(FileJob& job, size_t chunk, size_t worker_index);
     
-    // Collect completed futures periodically
-    void collectCompletedFutures();
+    std::vector<std::pair<uint64_t, std::string>> findTextFiles(const std::string& directory);
     
 #if USE_XLSX
     void writeXLSXResults(const std::string& output_filename);
@@ -129,6 +356,7 @@ public:
     void analyze(const std::string& directory, const std::string& expressions_file, 
                 const std::string& output_file, int num_threads = 4);
     void writeResults(const std::string& output_filename);
+    const StageTimings& timings() const { return stage_timings; }
 };
 
 void printUsage(const char* program_name);
@@ -0,0 +1,120 @@
+// Benchmark driver. Built once against each analyzer (BENCH_ASYNC selects the async
+// one), it runs analyze() end to end over a corpus and reports per-stage timings.
+//
+// Usage: whistle-bench <corpus_dir> <expressions_file> [num_threads] [runs] [engine]
+//
+// engine is automaton or std-regex; the async analyzer only has the std::regex engine.
+
+#ifdef BENCH_ASYNC
+#include "../async/whistle.h"
+using Analyzer = AsyncRegexAnalyzer;
+static const char* const ANALYZER_NAME = "AsyncRegexAnalyzer";
+#else
+#include "../whistle.h"
+using Analyzer = RegexAnalyzer;
+static const char* const ANALYZER_NAME = "RegexAnalyzer";
+#endif
+
+namespace {
+
+// Discards the analyzer's own console output while a run is timed
+class QuietOutput {
+private:
+    std::ofstream null_stream;
+    std::streambuf* saved;
+    
+public:
+    QuietOutput() : null_stream("/dev/null"), saved(std::cout.rdbuf(null_stream.rdbuf())) {}
+    ~QuietOutput() { std::cout.rdbuf(saved); }
+};
+
+void printRate(const char* label, double amount, double seconds, const char* unit) {
+    std::cout << "  " << std::left << std::setw(12) << label << std::right;
+    if (seconds > 0) {
+        std::cout << std::setw(12) << std::fixed << std::setprecision(1) << amount / seconds << " " << unit;
+    } else {
+        std::cout << std::setw(12) << "-";
+    }
+    std::cout << std::endl;
+}
+
+void printStage(const char* label, double seconds, double total) {
+    std::cout << "  " << std::left << std::setw(12) << label << std::right
+              << std::setw(10) << std::fixed << std::setprecision(3) << seconds << " s";
+    if (total > 0) {
+        std::cout << std::setw(8) << std::setprecision(1) << seconds / total * 100.0 << "% of wall";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 6) {
+        std::cout << "Usage: " << argv[0] << " <corpus_dir> <expressions_file> [num_threads] [runs] [automaton|std-regex]" << std::endl;
+        return 1;
+    }
+    
+    std::string corpus = argv[1];
+    std::string expressions_file = argv[2];
+    int num_threads = (argc >= 4) ? std::stoi(argv[3]) : 4;
+    int runs = (argc >= 5) ? std::max(1, std::stoi(argv[4])) : 3;
+#ifdef BENCH_ASYNC
+    std::string engine = (argc == 6) ? argv[5] : "std-regex";
+    if (engine != "std-regex") {
+        std::cerr << "Error: " << ANALYZER_NAME << " only has the std-regex engine" << std::endl;
+        return 1;
+    }
+#else
+    std::string engine = (argc == 6) ? argv[5] : "automaton";
+    MatchEngine match_engine;
+    if (!parseMatchEngine(engine, match_engine)) {
+        std::cerr << "Error: unknown engine " << engine << " (expected automaton or std-regex)" << std::endl;
+        return 1;
+    }
+#endif
+    std::string output_file = (std::filesystem::temp_directory_path() / "whistle-bench-output").string();
+    
+    std::cout << ANALYZER_NAME << " (" << engine << "): " << corpus << ", " << num_threads 
+              << " threads, best of " << runs << std::endl;
+    
+    // The fastest run is reported; the others only absorb cache and scheduling noise
+    StageTimings best;
+    for (int run = 0; run < runs; ++run) {
+        StageTimings timings;
+        try {
+            QuietOutput quiet;
+            Analyzer analyzer;
+#ifndef BENCH_ASYNC
+            analyzer.setMatchEngine(match_engine);
+#endif
+            analyzer.analyze(corpus, expressions_file, output_file, num_threads);
+            timings = analyzer.timings();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        
+        if (run == 0 || timings.total_seconds < best.total_seconds) {
+            best = timings;
+        }
+    }
+    
+    std::cout << "  files       " << std::setw(12) << best.files << std::endl;
+    std::cout << "  bytes       " << std::setw(12) << best.bytes << std::endl;
+    std::cout << "  findings    " << std::setw(12) << best.findings << std::endl;
+    printStage("total", best.total_seconds, 0);
+    printStage("walk", best.walk_seconds, best.total_seconds);
+    printStage("detect", best.detect_seconds, best.total_seconds);
+    printStage("match", best.match_seconds, best.total_seconds);
+    printStage("write", best.write_seconds, best.total_seconds);
+    printRate("throughput", best.bytes / (1024.0 * 1024.0), best.total_seconds, "MB/s");
+    printRate("findings", static_cast<double>(best.findings), best.total_seconds, "findings/s");
+    std::cout << "  (stages overlap; those run by workers are summed over the workers)" << std::endl;
+    
+    std::error_code error;
+    for (const char* extension : {"", ".xml", ".xlsx"}) {
+        std::filesystem::remove(output_file + extension, error);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+// Deterministic synthetic corpus for benchmarking whistle. The same scale always
+// produces byte-identical files, so runs on different builds are comparable.
+//
+// Usage: gencorpus <output_dir> [scale]
+//
+// Layout (sizes at scale 1):
+//   small/       5000 small text files (200 B - 4 KB) in nested directories, mixed hits
+//   huge/        dense.log (24 MB, a match on most lines) and prose.txt (24 MB, no matches)
+//   longlines/   one 1 MB single-line file per scale step and one file of 64 KB lines
+//   binary/      200 files of random bytes
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// splitmix64: tiny, fast and identical on every platform
+class Random {
+private:
+    uint64_t state;
+    
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    
+    size_t below(size_t bound) { return static_cast<size_t>(next() % bound); }
+};
+
+const char* const WORDS[] = {
+    "the", "request", "server", "returned", "value", "config", "session", "user",
+    "timeout", "during", "handler", "cache", "without", "parsing", "record", "batch",
+    "network", "worker", "queue", "latency", "error", "warning", "completed", "retry",
+    "pipeline", "storage", "index", "payload", "connection", "through", "between", "after"
+};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+void appendProse(std::string& out, Random& random, size_t words) {
+    for (size_t i = 0; i < words; ++i) {
+        if (i > 0) {
+            out += ' ';
+        }
+        out += WORDS[random.below(WORD_COUNT)];
+    }
+}
+
+void appendIP(std::string& out, Random& random) {
+    for (int octet = 0; octet < 4; ++octet) {
+        if (octet > 0) {
+            out += '.';
+        }
+        out += std::to_string(random.below(256));
+    }
+}
+
+// One of the things the bench expressions look for
+void appendHit(std::string& out, Random& random) {
+    switch (random.below(4)) {
+        case 0:
+            appendIP(out, random);
+            break;
+        case 1:
+            out += "user" + std::to_string(random.below(100000)) + "@example.com";
+            break;
+        case 2:
+            out += "https://service" + std::to_string(random.below(1000)) + ".example.org/api/v1/items";
+            break;
+        default:
+            out += "AKIA";
+            for (int i = 0; i < 16; ++i) {
+                out += "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567"[random.below(32)];
+            }
+            break;
+    }
+}
+
+// A line of prose with a hit in hit_percent percent of lines
+void appendLine(std::string& out, Random& random, size_t words, size_t hit_percent) {
+    appendProse(out, random, words / 2);
+    if (random.below(100) < hit_percent) {
+        out += ' ';
+        appendHit(out, random);
+    }
+    out += ' ';
+    appendProse(out, random, words - words / 2);
+    out += '\n';
+}
+
+void writeFile(const std::filesystem::path& path, const std::string& contents) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    if (!file) {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        std::exit(1);
+    }
+}
+
+void generateSmallFiles(const std::filesystem::path& root, size_t count, Random& random) {
+    for (size_t i = 0; i < count; ++i) {
+        std::string contents;
+        size_t target = 200 + random.below(3800);
+        while (contents.size() < target) {
+            appendLine(contents, random, 6 + random.below(14), 10);
+        }
+        
+        // 50 files per directory, 20 directories per parent
+        std::filesystem::path dir = root / ("d" + std::to_string(i / 1000)) / ("s" + std::to_string(i / 50 % 20));
+        writeFile(dir / ("file" + std::to_string(i) + ".txt"), contents);
+    }
+}
+
+void generateHugeFile(const std::filesystem::path& path, size_t size, size_t hit_percent, Random& random) {
+    std::string contents;
+    contents.reserve(size + 256);
+    while (contents.size() < size) {
+        appendLine(contents, random, 8 + random.below(16), hit_percent);
+    }
+    writeFile(path, contents);
+}
+
+void generateLongLines(const std::filesystem::path& root, size_t scale, Random& random) {
+    // Every finding carries its whole line, so hits are kept sparse here: one per ~32 KB
+    for (size_t file = 0; file < scale; ++file) {
+        std::string single;
+        while (single.size() < 1024 * 1024) {
+            appendProse(single, random, 5000);
+            single += ' ';
+            appendHit(single, random);
+            single += ' ';
+        }
+        single += '\n';
+        writeFile(root / ("single_line" + std::to_string(file) + ".txt"), single);
+    }
+    
+    std::string wide;
+    for (size_t line = 0; line < 64 * scale; ++line) {
+        std::string text;
+        while (text.size() < 64 * 1024) {
+            appendLine(text, random, 30, 20);
+            text.back() = ' ';
+        }
+        wide += text;
+        wide += '\n';
+    }
+    writeFile(root / "wide_lines.txt", wide);
+}
+
+void generateBinary(const std::filesystem::path& root, size_t count, Random& random) {
+    for (size_t i = 0; i < count; ++i) {
+        std::string contents(16 * 1024, '\0');
+        for (size_t j = 0; j < contents.size(); j += 8) {
+            uint64_t bits = random.next();
+            for (size_t k = 0; k < 8 && j + k < contents.size(); ++k) {
+                contents[j + k] = static_cast<char>(bits >> (8 * k));
+            }
+        }
+        writeFile(root / ("blob" + std::to_string(i) + ".bin"), contents);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cout << "Usage: " << argv[0] << " <output_dir> [scale]" << std::endl;
+        return 1;
+    }
+    
+    std::filesystem::path root = argv[1];
+    size_t scale = (argc == 3) ? static_cast<size_t>(std::max(1, std::atoi(argv[2]))) : 1;
+    
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+    
+    // Each part has its own seed so resizing one does not change the others
+    Random small_random(1);
+    generateSmallFiles(root / "small", 5000 * scale, small_random);
+    
+    Random dense_random(2);
+    generateHugeFile(root / "huge" / "dense.log", 24 * 1024 * 1024 * scale, 90, dense_random);
+    
+    Random prose_random(3);
+    generateHugeFile(root / "huge" / "prose.txt", 24 * 1024 * 1024 * scale, 0, prose_random);
+    
+    Random long_random(4);
+    generateLongLines(root / "longlines", scale, long_random);
+    
+    Random binary_random(5);
+    generateBinary(root / "binary", 200 * scale, binary_random);
+    
+    std::cout << "Generated benchmark corpus in " << root.string() << " (scale " << scale << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Regression test: a file large enough to be split across workers must report a match
+# that runs from one chunk into the next once, whole, with file-wide line numbers, both
+# when it was just written (chunks are read with pread) and once it has settled (chunks
+# are scanned in a mapping).
+#
+# usage: tests/chunk_split.sh <whistle binary>
+
+WHISTLE=${1:-bin/whistle}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Chunks end after the first newline at or past each 8 MiB. The 32-byte filler lines stop
+# 64 bytes short of the first 8 MiB; the line ending in BEGIN runs past it, so its
+# newline ends the first chunk and END starts the second. The file is about 72 MiB, over
+# the 64 MiB split threshold, and ends with a TAIL line in the last chunk.
+mkdir "$WORK/tree"
+{
+    yes 'filler text with no match in it' | head -n 262142
+    printf 'padding padding padding padding padding padding padding padding BEGIN\nEND of the span\n'
+    yes 'filler text with no match in it' | head -n 2097152
+    printf 'TAIL42\n'
+} > "$WORK/tree/big.txt"
+
+cat > "$WORK/expressions.properties" <<'PROPERTIES'
+[expressions]
+expression.span=BEGIN\sEND
+expression.tail=TAIL[0-9]+
+PROPERTIES
+
+tail_line=$(wc -l < "$WORK/tree/big.txt")
+expected="span 262143 BEGIN\\nEND
+tail $tail_line TAIL42"
+
+status=0
+
+# check <label>
+check() {
+    if ! "$WHISTLE" --format jsonl "$WORK/tree" "$WORK/expressions.properties" "$WORK/out" 4 > "$WORK/run.log" 2>&1; then
+        echo "FAIL chunk_split ($1): whistle exited with an error"
+        cat "$WORK/run.log"
+        status=1
+        return
+    fi
+
+    found=$(sed 's/^{"expression":"\([a-z]*\)".*"line":\([0-9]*\),"match":"\([^"]*\)".*/\1 \2 \3/' "$WORK/out.jsonl" | sort)
+    if [ "$found" != "$expected" ]; then
+        echo "FAIL chunk_split ($1): expected"
+        echo "$expected"
+        echo "got"
+        echo "$found"
+        status=1
+    else
+        echo "PASS chunk_split ($1)"
+    fi
+}
+
+check "recently written"
+touch -d '1 hour ago' "$WORK/tree/big.txt"
+check "settled"
+exit $status
@@ -0,0 +1,89 @@
+#!/bin/sh
+# Regression test: matches near a 1 MiB chunk boundary must be reported once, whole.
+# - an address that starts just before the boundary and ends further past it than
+#   the chunk look-ahead, not as the tail that starts at the boundary
+# - a match that only takes its longer alternative once text past the look-ahead is
+#   visible, on a line with no newline near the boundary, not as many short matches
+#
+# usage: tests/chunk_straddle.sh <whistle binary> <async whistle binary>
+
+WHISTLE=${1:-bin/whistle}
+ASYNC_WHISTLE=${2:-async/bin/whistle}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# The 5508-byte address starts 1002 bytes before the boundary at 1048576
+mkdir -p "$WORK/straddle/tree"
+{
+    yes 'filler text with no address in it' | head -c 1047573
+    printf '\n'
+    head -c 5496 /dev/zero | tr '\0' a
+    printf '@example.com\n'
+    yes 'filler text with no address in it' | head -c 8192
+} > "$WORK/straddle/tree/straddle.txt"
+
+cat > "$WORK/straddle/expressions.properties" <<'PROPERTIES'
+[expressions]
+expression.email=[a-zA-Z0-9._]+@[a-z]+\.(com|org)
+PROPERTIES
+
+# One line; 8000 a's start 100 bytes before the boundary and are followed by "ba", so
+# the whole run is one 8002-byte match of (?:a+b)?a
+mkdir -p "$WORK/backtrack/tree"
+{
+    head -c 1048476 /dev/zero | tr '\0' c
+    head -c 8000 /dev/zero | tr '\0' a
+    printf 'ba'
+    head -c 1200000 /dev/zero | tr '\0' c
+} > "$WORK/backtrack/tree/line.txt"
+
+cat > "$WORK/backtrack/expressions.properties" <<'PROPERTIES'
+[expressions]
+expression.backtrack=(?:a+b)?a
+PROPERTIES
+
+status=0
+
+# check <case> <cell pattern of a match> <expected length of every match>
+check() {
+    case=$1
+    cell=$2
+    expected=$3
+
+    # Length of every reported match, one per line
+    if ! "$WHISTLE" --format jsonl "$WORK/$case/tree" "$WORK/$case/expressions.properties" "$WORK/$case/sync" > "$WORK/$case/sync.log" 2>&1; then
+        echo "FAIL chunk_straddle ($case, sync): whistle exited with an error"
+        cat "$WORK/$case/sync.log"
+        status=1
+    else
+        lengths=$(awk -F'"match":"' '{ split($2, m, "\""); print length(m[1]) }' "$WORK/$case/sync.jsonl")
+        if [ "$lengths" != "$expected" ]; then
+            echo "FAIL chunk_straddle ($case, sync): expected one $expected-byte match, got: $lengths"
+            status=1
+        else
+            echo "PASS chunk_straddle ($case, sync)"
+        fi
+    fi
+
+    # The async build only writes a spreadsheet; each match appears once on its
+    # expression's sheet and once on the summary sheet
+    if ! "$ASYNC_WHISTLE" "$WORK/$case/tree" "$WORK/$case/expressions.properties" "$WORK/$case/async.xml" 2 > "$WORK/$case/async.log" 2>&1; then
+        echo "FAIL chunk_straddle ($case, async): whistle exited with an error"
+        cat "$WORK/$case/async.log"
+        status=1
+    else
+        found=$(sed -n 's/^Analysis complete. Found \([0-9]*\) matches$/\1/p' "$WORK/$case/async.log")
+        lengths=$(grep -o "<Data ss:Type=\"String\">$cell</Data>" "$WORK/$case/async.xml" \
+            | sed 's/<[^>]*>//g' | awk '{ print length($0) }' | sort -u)
+        if [ "$found" != "1" ] || [ "$lengths" != "$expected" ]; then
+            echo "FAIL chunk_straddle ($case, async): expected one $expected-byte match, got $found: $lengths"
+            status=1
+        else
+            echo "PASS chunk_straddle ($case, async)"
+        fi
+    fi
+}
+
+check straddle '[a-zA-Z0-9._]*@example\.com' 5508
+check backtrack 'a*ba' 8002
+exit $status
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Regression test: a file whose scan left part of it unscanned must not be cached, so a
+# later run with --cache scans it again instead of replaying the incomplete findings.
+#
+# usage: tests/incomplete_cache.sh <whistle binary>
+
+WHISTLE=${1:-bin/whistle}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# 30 matching lines around one line that backtracks badly; the automaton cannot run
+# the backreference, so std::regex giving up leaves the rest of the file unscanned
+mkdir "$WORK/tree"
+{
+    for i in 1 2 3 4 5 6 7 8 9 10; do echo "xyxy $i"; done
+    echo aaaaaaaaaaaa
+    for i in 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30; do echo "xyxy $i"; done
+} > "$WORK/tree/lines.txt"
+
+cat > "$WORK/bad.properties" <<'PROPERTIES'
+[expressions]
+expression.bad=(x?y?)((a|aa)+)+\1c|(xy)\4
+PROPERTIES
+
+run() {
+    "$WHISTLE" --cache "$WORK/scan.cache" --format jsonl "$@" "$WORK/tree" "$WORK/bad.properties" "$WORK/out" > "$WORK/run.log" 2>&1 \
+        && findings=$(wc -l < "$WORK/out.jsonl")
+}
+
+# A zero budget gives up on the slow line at once; the default budget scans it
+if ! run --regex-budget 0; then
+    echo "FAIL incomplete_cache: first run exited with an error"
+    cat "$WORK/run.log"
+    exit 1
+fi
+if ! grep -q "rest of file not scanned" "$WORK/run.log" || [ "$findings" -ne 10 ]; then
+    echo "FAIL incomplete_cache: expected the first run to stop after 10 findings, got $findings"
+    cat "$WORK/run.log"
+    exit 1
+fi
+
+if ! run; then
+    echo "FAIL incomplete_cache: second run exited with an error"
+    cat "$WORK/run.log"
+    exit 1
+fi
+if [ "$findings" -ne 30 ]; then
+    echo "FAIL incomplete_cache: expected the second run to rescan and find 30 matches, got $findings"
+    cat "$WORK/run.log"
+    exit 1
+fi
+
+# Unchanged since the second run, so this one replays the file from the cache
+if ! run || ! grep -q "Reused cached results for 1 of 1 files" "$WORK/run.log" || [ "$findings" -ne 30 ]; then
+    echo "FAIL incomplete_cache: expected the third run to reuse the cached file and its 30 matches, got $findings"
+    cat "$WORK/run.log"
+    exit 1
+fi
+
+# A corrupt cache must be ignored, not crash the run: first a huge length in the entry's
+# lines field (after the 24-byte header, the path and its length, and 25 bytes of key)
+cp "$WORK/scan.cache" "$WORK/valid.cache"
+path="$WORK/tree/lines.txt"
+printf '\000\000\000\000\377\000\000\000' | dd of="$WORK/scan.cache" bs=1 seek=$((57 + ${#path})) conv=notrunc 2>/dev/null
+for corruption in "huge length" "truncated file"; do
+    if ! run || ! grep -q "Ignoring truncated or corrupt scan cache" "$WORK/run.log" || [ "$findings" -ne 30 ]; then
+        echo "FAIL incomplete_cache: expected a cache with a $corruption to be ignored and 30 matches found"
+        cat "$WORK/run.log"
+        exit 1
+    fi
+    head -c $(($(wc -c < "$WORK/valid.cache") - 7)) "$WORK/valid.cache" > "$WORK/scan.cache"
+done
+echo "PASS incomplete_cache"
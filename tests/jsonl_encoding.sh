@@ -0,0 +1,39 @@
+#!/bin/sh
+# Regression test: JSON Lines output must stay valid JSON when the scanned text is not
+# UTF-8. Well-formed UTF-8 is written as is; every other byte (stray, overlong,
+# surrogate or cut-short sequences) is written as \u00XX, its Latin-1 reading.
+#
+# usage: tests/jsonl_encoding.sh <whistle binary>
+
+WHISTLE=${1:-bin/whistle}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Enough plain lines ahead of the mixed one for the file to be classified as text
+mkdir "$WORK/tree"
+{
+    yes 'plain ascii filler line' | head -n 200
+    printf 'key=\377\376 caf\303\251 \342\202\254 \360\237\230\200 \300\257 \355\240\200 \342\202 end\n'
+} > "$WORK/tree/mixed.txt"
+
+cat > "$WORK/expressions.properties" <<'PROPERTIES'
+[expressions]
+expression.key=key=
+PROPERTIES
+
+if ! "$WHISTLE" --format jsonl "$WORK/tree" "$WORK/expressions.properties" "$WORK/out" > "$WORK/run.log" 2>&1; then
+    echo "FAIL jsonl_encoding: whistle exited with an error"
+    cat "$WORK/run.log"
+    exit 1
+fi
+
+expected=$(printf '"statement":"key=\\u00ff\\u00fe caf\303\251 \342\202\254 \360\237\230\200 \\u00c0\\u00af \\u00ed\\u00a0\\u0080 \\u00e2\\u0082 end"}')
+found=$(sed 's/.*\("statement":\)/\1/' "$WORK/out.jsonl")
+if [ "$found" != "$expected" ]; then
+    echo "FAIL jsonl_encoding: expected"
+    echo "$expected"
+    echo "got"
+    echo "$found"
+    exit 1
+fi
+echo "PASS jsonl_encoding"
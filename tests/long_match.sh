@@ -0,0 +1,43 @@
+#!/bin/sh
+# Regression test: a match that starts in one window and ends past that window's
+# look-ahead must be reported once, whole, under either engine, and not as the tail
+# that falls in the next window.
+#
+# usage: tests/long_match.sh <whistle binary>
+
+WHISTLE=${1:-bin/whistle}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir "$WORK/tree"
+{
+    head -c 100 /dev/zero | tr '\0' x
+    printf ' '
+    head -c 60000 /dev/zero | tr '\0' a
+    printf '@example.com\n'
+} > "$WORK/tree/long.txt"
+
+cat > "$WORK/email.properties" <<'PROPERTIES'
+[expressions]
+expression.email=[A-Za-z0-9._%+-]+@[A-Za-z0-9.-]+\.[A-Za-z]{2,}
+PROPERTIES
+
+status=0
+for engine in automaton std-regex; do
+    if ! "$WHISTLE" --engine "$engine" --format jsonl "$WORK/tree" "$WORK/email.properties" "$WORK/$engine" > "$WORK/$engine.log" 2>&1; then
+        echo "FAIL long_match ($engine): whistle exited with an error"
+        cat "$WORK/$engine.log"
+        status=1
+        continue
+    fi
+    
+    # One finding, 60012 bytes long, starting at the first 'a'
+    lengths=$(awk -F'"match":"' '{ split($2, m, "\""); print length(m[1]) ":" substr(m[1], 1, 1) }' "$WORK/$engine.jsonl")
+    if [ "$lengths" != "60012:a" ]; then
+        echo "FAIL long_match ($engine): expected one 60012-byte match, got: $lengths"
+        status=1
+    else
+        echo "PASS long_match ($engine)"
+    fi
+done
+exit $status
@@ -1,38 +1,65 @@
 #include "whistle.h"
 
 // XMLSpreadsheetWriter implementation
-std::string XMLSpreadsheetWriter::escapeXML(const std::string& text) {
-    if (text.empty()) {
-        return text;
-    }
+// Returns the first of & < > " ' in [p, end), or end
+static const char* findXMLSpecial(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
     
-    std::string escaped;
-    escaped.reserve(text.length() * 2); // Reserve extra space for escapes
+    for (; p + 16 <= end; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, amp), _mm_cmpeq_epi8(block, lt)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, gt), _mm_cmpeq_epi8(block, quot)));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, apos));
+        
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
     
-    for (size_t i = 0; i < text.length(); ++i) {
-        char c = text[i];
-        switch (c) {
-            case '&':
-                escaped += "&amp;";
-                break;
-            case '<':
-                escaped += "&lt;";
-                break;
-            case '>':
-                escaped += "&gt;";
-                break;
-            case '"':
-                escaped += "&quot;";
-                break;
-            case '\'':
-                escaped += "&apos;";
-                break;
-            default:
-                escaped += c;
-                break;
+    for (; p < end; ++p) {
+        char c = *p;
+        if (c == '&' || c == '<' || c == '>' || c == '"' || c == '\'') {
+            return p;
         }
     }
+    return end;
+}
+
+// Appends text to out with XML special characters escaped; the clean runs between
+// them are copied in bulk
+void XMLSpreadsheetWriter::appendEscaped(std::string& out, std::string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
     
+    while (p < end) {
+        const char* special = findXMLSpecial(p, end);
+        out.append(p, special);
+        if (special == end) {
+            break;
+        }
+        
+        switch (*special) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += "&apos;"; break;
+        }
+        p = special + 1;
+    }
+}
+
+std::string XMLSpreadsheetWriter::escapeXML(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.length() + text.length() / 8);
+    appendEscaped(escaped, text);
     return escaped;
 }
 
@@ -59,24 +86,89 @@ std::string XMLSpreadsheetWriter::cleanSheetName(const std::string& name) {
     return clean;
 }
 
-XMLSpreadsheetWriter::XMLSpreadsheetWriter(const std::string& filename) : file(filename) {}
+XMLSpreadsheetWriter::XMLSpreadsheetWriter(const std::string& filename, size_t buffer_limit) 
+    : file_buffer(FILE_BUFFER_SIZE), buffer_limit(buffer_limit) {
+    // The buffer has to be installed before the file is opened to take effect
+    file.rdbuf()->pubsetbuf(file_buffer.data(), static_cast<std::streamsize>(file_buffer.size()));
+    file.open(filename, std::ios::binary);
+}
 
 XMLSpreadsheetWriter::~XMLSpreadsheetWriter() {
+    for (auto& entry : worksheets) {
+        if (entry.second.spill) {
+            std::fclose(entry.second.spill);
+        }
+    }
+    
     if (file.is_open()) {
         file.close();
     }
 }
 
 void XMLSpreadsheetWriter::addWorksheet(const std::string& name) {
-    std::string clean_name = cleanSheetName(name);
-    worksheets[clean_name] = std::vector<std::vector<std::string>>();
+    // Adding an existing sheet keeps its rows
+    worksheets.emplace(cleanSheetName(name), Worksheet());
+}
+
+void XMLSpreadsheetWriter::addRow(const std::string& worksheet_name, std::initializer_list<SpreadsheetCell> row) {
+    // Names are normally clean already, which avoids building a cleaned copy per row
+    auto it = worksheets.find(worksheet_name);
+    if (it == worksheets.end()) {
+        it = worksheets.find(cleanSheetName(worksheet_name));
+        if (it == worksheets.end()) {
+            return;
+        }
+    }
+    
+    Worksheet& sheet = it->second;
+    std::string& out = sheet.buffer;
+    size_t rendered_from = out.size();
+    bool is_header = (sheet.row_count == 0);
+    
+    out += "   <Row>\n";
+    for (const SpreadsheetCell& cell : row) {
+        out += is_header ? "    <Cell ss:StyleID=\"Header\">\n" : "    <Cell ss:StyleID=\"Cell\">\n";
+        if (cell.is_number) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), cell.number);
+            out += "     <Data ss:Type=\"Number\">";
+            out.append(digits, result.ptr);
+        } else {
+            out += "     <Data ss:Type=\"String\">";
+            appendEscaped(out, cell.text);
+        }
+        out += "</Data>\n";
+        out += "    </Cell>\n";
+    }
+    out += "   </Row>\n";
+    
+    sheet.row_count++;
+    buffered_bytes += out.size() - rendered_from;
+    if (buffered_bytes > buffer_limit) {
+        spillWorksheets();
+    }
 }
 
-void XMLSpreadsheetWriter::addRow(const std::string& worksheet_name, const std::vector<std::string>& row) {
-    std::string clean_name = cleanSheetName(worksheet_name);
-    if (worksheets.find(clean_name) != worksheets.end()) {
-        worksheets[clean_name].push_back(row);
+void XMLSpreadsheetWriter::spillWorksheets() {
+    for (auto& entry : worksheets) {
+        Worksheet& sheet = entry.second;
+        if (sheet.buffer.empty()) {
+            continue;
+        }
+        
+        if (!sheet.spill) {
+            sheet.spill = std::tmpfile();
+            if (!sheet.spill) {
+                throw std::runtime_error("Failed to create spill file for worksheet: " + entry.first);
+            }
+        }
+        if (std::fwrite(sheet.buffer.data(), 1, sheet.buffer.size(), sheet.spill) != sheet.buffer.size()) {
+            throw std::runtime_error("Failed to write spill file for worksheet: " + entry.first);
+        }
+        
+        std::string().swap(sheet.buffer); // Release the memory, not just the contents
     }
+    buffered_bytes = 0;
 }
 
 bool XMLSpreadsheetWriter::writeFile() {
@@ -85,233 +177,3287 @@ bool XMLSpreadsheetWriter::writeFile() {
     }
     
     // Write XML header
-    file << "<?xml version=\"1.0\"?>" << std::endl;
-    file << "<?mso-application progid=\"Excel.Sheet\"?>" << std::endl;
-    file << "<Workbook xmlns=\"urn:schemas-microsoft-com:office:spreadsheet\"" << std::endl;
-    file << " xmlns:o=\"urn:schemas-microsoft-com:office:office\"" << std::endl;
-    file << " xmlns:x=\"urn:schemas-microsoft-com:office:excel\"" << std::endl;
-    file << " xmlns:ss=\"urn:schemas-microsoft-com:office:spreadsheet\"" << std::endl;
-    file << " xmlns:html=\"http://www.w3.org/TR/REC-html40\">" << std::endl;
+    file << "<?xml version=\"1.0\"?>\n";
+    file << "<?mso-application progid=\"Excel.Sheet\"?>\n";
+    file << "<Workbook xmlns=\"urn:schemas-microsoft-com:office:spreadsheet\"\n";
+    file << " xmlns:o=\"urn:schemas-microsoft-com:office:office\"\n";
+    file << " xmlns:x=\"urn:schemas-microsoft-com:office:excel\"\n";
+    file << " xmlns:ss=\"urn:schemas-microsoft-com:office:spreadsheet\"\n";
+    file << " xmlns:html=\"http://www.w3.org/TR/REC-html40\">\n";
     
     // Write document properties
-    file << " <DocumentProperties xmlns=\"urn:schemas-microsoft-com:office:office\">" << std::endl;
-    file << "  <Created>" << std::chrono::system_clock::now().time_since_epoch().count() << "</Created>" << std::endl;
-    file << "  <Application>Regex Analyzer</Application>" << std::endl;
-    file << " </DocumentProperties>" << std::endl;
+    file << " <DocumentProperties xmlns=\"urn:schemas-microsoft-com:office:office\">\n";
+    file << "  <Created>" << std::chrono::system_clock::now().time_since_epoch().count() << "</Created>\n";
+    file << "  <Application>Regex Analyzer</Application>\n";
+    file << " </DocumentProperties>\n";
     
     // Write styles
-    file << " <Styles>" << std::endl;
-    file << "  <Style ss:ID=\"Header\">" << std::endl;
-    file << "   <Font ss:Bold=\"1\"/>" << std::endl;
-    file << "   <Interior ss:Color=\"#C0C0C0\" ss:Pattern=\"Solid\"/>" << std::endl;
-    file << "   <Borders>" << std::endl;
-    file << "    <Border ss:Position=\"Bottom\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Left\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Right\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Top\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "   </Borders>" << std::endl;
-    file << "  </Style>" << std::endl;
-    file << "  <Style ss:ID=\"Cell\">" << std::endl;
-    file << "   <Borders>" << std::endl;
-    file << "    <Border ss:Position=\"Bottom\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Left\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Right\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "    <Border ss:Position=\"Top\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>" << std::endl;
-    file << "   </Borders>" << std::endl;
-    file << "   <Alignment ss:Vertical=\"Top\" ss:WrapText=\"1\"/>" << std::endl;
-    file << "  </Style>" << std::endl;
-    file << " </Styles>" << std::endl;
+    file << " <Styles>\n";
+    file << "  <Style ss:ID=\"Header\">\n";
+    file << "   <Font ss:Bold=\"1\"/>\n";
+    file << "   <Interior ss:Color=\"#C0C0C0\" ss:Pattern=\"Solid\"/>\n";
+    file << "   <Borders>\n";
+    file << "    <Border ss:Position=\"Bottom\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Left\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Right\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Top\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "   </Borders>\n";
+    file << "  </Style>\n";
+    file << "  <Style ss:ID=\"Cell\">\n";
+    file << "   <Borders>\n";
+    file << "    <Border ss:Position=\"Bottom\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Left\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Right\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "    <Border ss:Position=\"Top\" ss:LineStyle=\"Continuous\" ss:Weight=\"1\"/>\n";
+    file << "   </Borders>\n";
+    file << "   <Alignment ss:Vertical=\"Top\" ss:WrapText=\"1\"/>\n";
+    file << "  </Style>\n";
+    file << " </Styles>\n";
     
     // Write worksheets
-    for (const auto& [sheet_name, rows] : worksheets) {
-        file << " <Worksheet ss:Name=\"" << escapeXML(sheet_name) << "\">" << std::endl;
-        file << "  <Table>" << std::endl;
+    std::vector<char> copy_buffer(64 * 1024);
+    for (auto& [sheet_name, sheet] : worksheets) {
+        file << " <Worksheet ss:Name=\"" << escapeXML(sheet_name) << "\">\n";
+        file << "  <Table>\n";
         
         // Set column widths
-        file << "   <Column ss:Width=\"120\"/>" << std::endl; // Finding
-        file << "   <Column ss:Width=\"240\"/>" << std::endl; // File
-        file << "   <Column ss:Width=\"60\"/>" << std::endl;  // Line
-        file << "   <Column ss:Width=\"120\"/>" << std::endl; // Comments
-        file << "   <Column ss:Width=\"90\"/>" << std::endl;  // Ease
-        file << "   <Column ss:Width=\"90\"/>" << std::endl;  // Significance
-        file << "   <Column ss:Width=\"90\"/>" << std::endl;  // Risk
-        file << "   <Column ss:Width=\"360\"/>" << std::endl; // Statement
-        
-        for (size_t i = 0; i < rows.size(); ++i) {
-            const auto& row = rows[i];
-            file << "   <Row>" << std::endl;
-            
-            for (size_t j = 0; j < row.size(); ++j) {
-                std::string style_id = (i == 0) ? "Header" : "Cell";
-                std::string cell_data = escapeXML(row[j]);
-                
-                // Check if it's a number (for line numbers)
-                bool is_number = false;
-                if (j == 2 && i > 0) { // Line number column, not header
-                    try {
-                        std::stoi(row[j]);
-                        is_number = true;
-                    } catch (...) {
-                        is_number = false;
-                    }
-                }
-                
-                file << "    <Cell ss:StyleID=\"" << style_id << "\">" << std::endl;
-                if (is_number) {
-                    file << "     <Data ss:Type=\"Number\">" << cell_data << "</Data>" << std::endl;
-                } else {
-                    file << "     <Data ss:Type=\"String\">" << cell_data << "</Data>" << std::endl;
-                }
-                file << "    </Cell>" << std::endl;
+        file << "   <Column ss:Width=\"120\"/>\n"; // Finding
+        file << "   <Column ss:Width=\"240\"/>\n"; // File
+        file << "   <Column ss:Width=\"60\"/>\n";  // Line
+        file << "   <Column ss:Width=\"120\"/>\n"; // Comments
+        file << "   <Column ss:Width=\"90\"/>\n";  // Ease
+        file << "   <Column ss:Width=\"90\"/>\n";  // Significance
+        file << "   <Column ss:Width=\"90\"/>\n";  // Risk
+        file << "   <Column ss:Width=\"360\"/>\n"; // Statement
+        
+        // Rows spilled earlier come first, then whatever is still buffered
+        if (sheet.spill) {
+            std::fflush(sheet.spill);
+            std::rewind(sheet.spill);
+            size_t bytes_read;
+            while ((bytes_read = std::fread(copy_buffer.data(), 1, copy_buffer.size(), sheet.spill)) > 0) {
+                file.write(copy_buffer.data(), static_cast<std::streamsize>(bytes_read));
             }
-            
-            file << "   </Row>" << std::endl;
+            std::fclose(sheet.spill);
+            sheet.spill = nullptr;
         }
+        file << sheet.buffer;
+        std::string().swap(sheet.buffer);
         
-        file << "  </Table>" << std::endl;
+        file << "  </Table>\n";
         
         // Add worksheet options (freeze header row so it stays visible when scrolling)
-        if (!rows.empty()) {
-            file << "  <WorksheetOptions xmlns=\"urn:schemas-microsoft-com:office:excel\">" << std::endl;
-            file << "   <FreezePanes/>" << std::endl;
-            file << "   <FrozenNoSplit/>" << std::endl;
-            file << "   <SplitHorizontal>1</SplitHorizontal>" << std::endl;
-            file << "   <TopRowBottomPane>1</TopRowBottomPane>" << std::endl;
-            file << "   <ActivePane>2</ActivePane>" << std::endl;
-            file << "  </WorksheetOptions>" << std::endl;
+        if (sheet.row_count > 0) {
+            file << "  <WorksheetOptions xmlns=\"urn:schemas-microsoft-com:office:excel\">\n";
+            file << "   <FreezePanes/>\n";
+            file << "   <FrozenNoSplit/>\n";
+            file << "   <SplitHorizontal>1</SplitHorizontal>\n";
+            file << "   <TopRowBottomPane>1</TopRowBottomPane>\n";
+            file << "   <ActivePane>2</ActivePane>\n";
+            file << "  </WorksheetOptions>\n";
         }
         
-        file << " </Worksheet>" << std::endl;
+        file << " </Worksheet>\n";
     }
     
-    file << "</Workbook>" << std::endl;
+    file << "</Workbook>\n";
     
-    return true;
+    // Nothing has been flushed yet, so write errors surface here
+    file.flush();
+    return file.good();
 }
 
 bool XMLSpreadsheetWriter::isOpen() const {
     return file.is_open();
 }
 
-// ProgressTracker implementation
-void ProgressTracker::setTotal(int t) {
-    total = t;
-    start_time = std::chrono::steady_clock::now();
+// Output sink implementation
+// Replaces any extension of base's filename with extension (which includes the dot);
+// dots in directory components are left alone
+static std::string outputPath(const std::string& base, const std::string& extension) {
+    return std::filesystem::path(base).replace_extension(extension).string();
 }
 
-void ProgressTracker::increment() {
-    processed++;
-    printProgress();
+std::unique_ptr<OutputSink> OutputSink::create(const std::string& format, const std::string& output_file) {
+    if (format == "xlsx") {
+#if USE_XLSX
+        return std::make_unique<XLSXSink>(output_file);
+#else
+        throw std::runtime_error("XLSX output requires building with libxlsxwriter");
+#endif
+    }
+    if (format == "xml") {
+        return std::make_unique<XMLSpreadsheetSink>(outputPath(output_file, ".xml"));
+    }
+    if (format == "jsonl") {
+        return std::make_unique<JsonLinesSink>(outputPath(output_file, ".jsonl"));
+    }
+    if (format == "csv") {
+        return std::make_unique<CsvSink>(outputPath(output_file, ".csv"));
+    }
+    if (format == "bin") {
+        return std::make_unique<BinarySink>(outputPath(output_file, ".bin"));
+    }
+    throw std::runtime_error("Unknown output format: " + format);
 }
 
-void ProgressTracker::printProgress() const {
-    std::lock_guard<std::mutex> lock(print_mutex);
-    
-    int proc = processed.load();
-    int tot = total.load();
-    
-    if (tot == 0) return;
-    
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+FileSink::FileSink(const std::string& filename, const char* description)
+    : path(filename), description(description), file_buffer(FILE_BUFFER_SIZE) {
+    // The buffer has to be installed before the file is opened to take effect
+    file.rdbuf()->pubsetbuf(file_buffer.data(), static_cast<std::streamsize>(file_buffer.size()));
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("Failed to create ") + description + " file: " + filename);
+    }
+}
+
+void FileSink::emit() {
+    file.write(record_buffer.data(), static_cast<std::streamsize>(record_buffer.size()));
+    record_buffer.clear();
+}
+
+void FileSink::finish() {
+    file.flush();
+    if (!file.good()) {
+        throw std::runtime_error(std::string("Failed to write ") + description + " file: " + path);
+    }
+    file.close();
+    std::cout << "Successfully created " << description << " file: " << path 
+              << " (" << record_count << " findings)" << std::endl;
+}
+
+JsonLinesSink::JsonLinesSink(const std::string& filename) : FileSink(filename, "JSON Lines") {}
+
+// Length of the well-formed UTF-8 sequence at text[i], or 0 if there is none: no
+// overlong forms, surrogates or code points past U+10FFFF
+static size_t utf8SequenceLength(std::string_view text, size_t i) {
+    unsigned char lead = static_cast<unsigned char>(text[i]);
+    unsigned char low = 0x80;    // Range of the second byte
+    unsigned char high = 0xBF;
+    size_t length;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) low = 0xA0;
+        if (lead == 0xED) high = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) low = 0x90;
+        if (lead == 0xF4) high = 0x8F;
+    } else {
+        return 0;
+    }
+    if (text.size() - i < length) {
+        return 0;
+    }
     
-    double percentage = (double)proc / tot * 100.0;
-    int remaining = tot - proc;
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char byte = static_cast<unsigned char>(text[i + k]);
+        if (byte < low || byte > high) {
+            return 0;
+        }
+        low = 0x80;
+        high = 0xBF;
+    }
+    return length;
+}
+
+// Scanned files need not be UTF-8: a byte that does not start a well-formed sequence is
+// written as the code point of the same value (its Latin-1 reading), so every string
+// is valid JSON
+void JsonLinesSink::appendString(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
     
-    // Estimate time remaining
-    double eta_seconds = 0;
-    if (proc > 0 && elapsed > 0) {
-        double rate = (double)proc / elapsed;
-        eta_seconds = remaining / rate;
+    out += '"';
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        unsigned char byte = static_cast<unsigned char>(c);
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                size_t length = (byte >= 0x80) ? utf8SequenceLength(text, i) : 1;
+                if (byte < 0x20 || length == 0) {
+                    out += "\\u00";
+                    out += hex[byte >> 4];
+                    out += hex[byte & 0xF];
+                } else {
+                    out.append(text.data() + i, length);
+                    i += length - 1;
+                }
+            }
+        }
+    }
+    out += '"';
+}
+
+void JsonLinesSink::write(const FindingRecord& record) {
+    record_buffer += "{\"expression\":";
+    appendString(record_buffer, record.expression);
+    record_buffer += ",\"file\":";
+    appendString(record_buffer, record.file);
+    record_buffer += ",\"line\":";
+    record_buffer += std::to_string(record.line_number);
+    record_buffer += ",\"match\":";
+    appendString(record_buffer, record.match());
+    record_buffer += ",\"statement\":";
+    appendString(record_buffer, record.statement);
+    record_buffer += "}\n";
+    emit();
+    record_count++;
+}
+
+CsvSink::CsvSink(const std::string& filename) : FileSink(filename, "CSV") {}
+
+void CsvSink::appendField(std::string& out, std::string_view text) {
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.append(text.data(), text.size());
+        return;
     }
     
-    std::cout << "\r[" << std::setw(3) << std::fixed << std::setprecision(1) 
-              << percentage << "%] Processed: " << proc << "/" << tot 
-              << " | Remaining: " << remaining;
+    out += '"';
+    for (char c : text) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+void CsvSink::begin(const std::vector<std::string>& expression_names) {
+    (void)expression_names;
+    record_buffer += "Expression,File,Line,Finding,Statement\r\n";
+    emit();
+}
+
+void CsvSink::write(const FindingRecord& record) {
+    appendField(record_buffer, record.expression);
+    record_buffer += ',';
+    appendField(record_buffer, record.file);
+    record_buffer += ',';
+    record_buffer += std::to_string(record.line_number);
+    record_buffer += ',';
+    appendField(record_buffer, record.match());
+    record_buffer += ',';
+    appendField(record_buffer, record.statement);
+    record_buffer += "\r\n";
+    emit();
+    record_count++;
+}
+
+BinarySink::BinarySink(const std::string& filename) : FileSink(filename, "binary findings") {}
+
+void BinarySink::appendU32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        record_buffer += static_cast<char>((value >> shift) & 0xFF);
+    }
+}
+
+void BinarySink::appendBytes(std::string_view bytes) {
+    appendU32(static_cast<uint32_t>(bytes.size()));
+    record_buffer.append(bytes.data(), bytes.size());
+}
+
+void BinarySink::begin(const std::vector<std::string>& expression_names) {
+    record_buffer += "WHSTFND1";
+    appendU32(static_cast<uint32_t>(expression_names.size()));
+    for (const std::string& name : expression_names) {
+        appendBytes(name);
+    }
+    emit();
+}
+
+void BinarySink::write(const FindingRecord& record) {
+    if (record_count == 0 || record.file != current_file) {
+        current_file.assign(record.file.data(), record.file.size());
+        record_buffer += 'F';
+        appendBytes(record.file);
+    }
     
-    if (eta_seconds > 0) {
-        int eta_min = (int)(eta_seconds / 60);
-        int eta_sec = (int)(eta_seconds) % 60;
-        std::cout << " | ETA: " << eta_min << "m " << eta_sec << "s";
+    record_buffer += 'M';
+    appendU32(record.expression_id);
+    appendU32(record.line_number);
+    appendU32(record.match_offset);
+    appendU32(record.match_length);
+    appendBytes(record.statement);
+    emit();
+    record_count++;
+}
+
+XMLSpreadsheetSink::XMLSpreadsheetSink(const std::string& filename) : path(filename), writer(filename) {
+    if (!writer.isOpen()) {
+        throw std::runtime_error("Failed to create XML spreadsheet: " + filename);
+    }
+}
+
+void XMLSpreadsheetSink::addHeader(const std::string& sheet_name) {
+    writer.addRow(sheet_name, {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
+}
+
+// Each finding goes into its expression's sheet and into Summary; a sheet is created
+// when its expression first appears
+void XMLSpreadsheetSink::write(const FindingRecord& record) {
+    static const std::string summary_name = "Summary";
+    if (total == 0) {
+        writer.addWorksheet(summary_name);
+        addHeader(summary_name);
     }
     
-    std::cout << std::flush;
+    auto sheet = sheet_counts.find(record.expression);
+    if (sheet == sheet_counts.end()) {
+        sheet = sheet_counts.emplace(std::string(record.expression), 0).first;
+        writer.addWorksheet(sheet->first);
+        addHeader(sheet->first);
+    }
+    sheet->second++;
+    total++;
     
-    if (proc == tot) {
-        std::cout << std::endl << "Processing complete!" << std::endl;
+    // Rows are rendered straight from the record; the line number is a typed Number cell
+    for (const std::string* sheet_name : {&sheet->first, &summary_name}) {
+        writer.addRow(*sheet_name, {
+            record.match(),              // Actual regex match
+            record.file,
+            static_cast<int>(record.line_number),
+            "", // Comments (blank)
+            "", // Ease (blank)
+            "", // Significance (blank)
+            "", // Risk (blank)
+            record.statement             // Full line
+        });
     }
 }
 
-// RegexAnalyzer implementation
-std::vector<ExpressionPattern> RegexAnalyzer::loadExpressions(const std::string& filename) {
-    std::vector<ExpressionPattern> patterns;
-    std::ifstream file(filename);
+void XMLSpreadsheetSink::finish() {
+    for (const auto& [expr_name, count] : sheet_counts) {
+        std::cout << "Created sheet: " << expr_name << " with " << count << " findings" << std::endl;
+    }
+    if (total > 0) {
+        std::cout << "Created Summary sheet with " << total << " total findings" << std::endl;
+    }
     
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open expressions.properties file");
+    if (!writer.writeFile()) {
+        throw std::runtime_error("Failed to write XML spreadsheet file");
     }
     
-    std::string line;
-    bool in_expressions_section = false;
+    std::cout << "Successfully created XML Spreadsheet file: " << path << std::endl;
+    std::cout << "This file can be opened in Excel, LibreOffice Calc, or Google Sheets" << std::endl;
+}
+
+#if USE_XLSX
+XLSXSink::XLSXSink(const std::string& filename) : path(filename) {}
+
+void XLSXSink::write(const FindingRecord& record) {
+    records.push_back(record);
+}
+
+void XLSXSink::finish() {
+    // Create workbook
+    lxw_workbook* workbook = workbook_new(path.c_str());
+    if (!workbook) {
+        throw std::runtime_error("Failed to create Excel workbook: " + path);
+    }
     
-    while (std::getline(file, line)) {
-        // Trim whitespace
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        
-        // Skip empty lines and comments
-        if (line.empty() || line[0] == '#') continue;
+    // Create formats
+    lxw_format* header_format = workbook_add_format(workbook);
+    format_set_bold(header_format);
+    format_set_bg_color(header_format, LXW_COLOR_GRAY);
+    format_set_border(header_format, LXW_BORDER_THIN);
+    
+    lxw_format* cell_format = workbook_add_format(workbook);
+    format_set_border(cell_format, LXW_BORDER_THIN);
+    format_set_text_wrap(cell_format);
+    
+    // Group findings by expression
+    std::map<std::string_view, std::vector<const FindingRecord*>> grouped_findings;
+    
+    for (const auto& record : records) {
+        grouped_findings[record.expression].push_back(&record);
+    }
+    
+    // Create worksheet for each expression
+    for (const auto& [expr_name, findings] : grouped_findings) {
+        // Clean sheet name (Excel has restrictions on sheet names)
+        std::string sheet_name(expr_name);
+        // Replace invalid characters
+        for (char& c : sheet_name) {
+            if (c == '\\' || c == '/' || c == '?' || c == '*' || c == '[' || c == ']' || c == ':') {
+                c = '_';
+            }
+        }
+        // Limit to 31 characters (Excel limit)
+        if (sheet_name.length() > 31) {
+            sheet_name = sheet_name.substr(0, 31);
+        }
         
-        // Check for [expressions] section
-        if (line == "[expressions]") {
-            in_expressions_section = true;
+        lxw_worksheet* worksheet = workbook_add_worksheet(workbook, sheet_name.c_str());
+        if (!worksheet) {
+            std::cerr << "Failed to create worksheet: " << sheet_name << std::endl;
             continue;
         }
         
-        // Check for other sections
-        if (line[0] == '[' && line.back() == ']') {
-            in_expressions_section = false;
-            continue;
+        // Set column widths
+        worksheet_set_column(worksheet, 0, 0, 20, nullptr); // Finding
+        worksheet_set_column(worksheet, 1, 1, 40, nullptr); // File
+        worksheet_set_column(worksheet, 2, 2, 10, nullptr); // Line
+        worksheet_set_column(worksheet, 3, 3, 20, nullptr); // Comments
+        worksheet_set_column(worksheet, 4, 4, 15, nullptr); // Ease
+        worksheet_set_column(worksheet, 5, 5, 15, nullptr); // Significance
+        worksheet_set_column(worksheet, 6, 6, 15, nullptr); // Risk
+        worksheet_set_column(worksheet, 7, 7, 60, nullptr); // Statement
+        
+        // Write headers
+        worksheet_write_string(worksheet, 0, 0, "Finding", header_format);
+        worksheet_write_string(worksheet, 0, 1, "File", header_format);
+        worksheet_write_string(worksheet, 0, 2, "Line", header_format);
+        worksheet_write_string(worksheet, 0, 3, "Comments", header_format);
+        worksheet_write_string(worksheet, 0, 4, "Ease", header_format);
+        worksheet_write_string(worksheet, 0, 5, "Significance", header_format);
+        worksheet_write_string(worksheet, 0, 6, "Risk", header_format);
+        worksheet_write_string(worksheet, 0, 7, "Statement", header_format);
+        
+        // Write findings
+        int row = 1;
+        for (const FindingRecord* record : findings) {
+            worksheet_write_string(worksheet, row, 0, std::string(record->match()).c_str(), cell_format);  // Actual match
+            worksheet_write_string(worksheet, row, 1, std::string(record->file).c_str(), cell_format);
+            worksheet_write_number(worksheet, row, 2, record->line_number, cell_format);
+            worksheet_write_string(worksheet, row, 3, "", cell_format); // Comments (blank)
+            worksheet_write_string(worksheet, row, 4, "", cell_format); // Ease (blank)
+            worksheet_write_string(worksheet, row, 5, "", cell_format); // Significance (blank)
+            worksheet_write_string(worksheet, row, 6, "", cell_format); // Risk (blank)
+            worksheet_write_string(worksheet, row, 7, std::string(record->statement).c_str(), cell_format);     // Full line
+            row++;
         }
         
-        if (in_expressions_section) {
-            // Parse expression.name=pattern
-            size_t eq_pos = line.find('=');
-            if (eq_pos != std::string::npos) {
-                std::string key = line.substr(0, eq_pos);
-                std::string value = line.substr(eq_pos + 1);
-                
-                // Trim key and value
-                key.erase(0, key.find_first_not_of(" \t"));
-                key.erase(key.find_last_not_of(" \t") + 1);
-                value.erase(0, value.find_first_not_of(" \t"));
-                value.erase(value.find_last_not_of(" \t") + 1);
-                
-                if (key.substr(0, 11) == "expression.") {
-                    std::string expr_name = key.substr(11);
+        // Freeze the header row so it stays visible when scrolling
+        worksheet_freeze_panes(worksheet, 1, 0);
+        
+        std::cout << "Created sheet: " << sheet_name << " with " << findings.size() << " findings" << std::endl;
+    }
+    
+    // Create a summary worksheet with all findings
+    if (!records.empty()) {
+        lxw_worksheet* summary_worksheet = workbook_add_worksheet(workbook, "Summary");
+        if (summary_worksheet) {
+            // Set column widths
+            worksheet_set_column(summary_worksheet, 0, 0, 20, nullptr); // Finding
+            worksheet_set_column(summary_worksheet, 1, 1, 40, nullptr); // File
+            worksheet_set_column(summary_worksheet, 2, 2, 10, nullptr); // Line
+            worksheet_set_column(summary_worksheet, 3, 3, 20, nullptr); // Comments
+            worksheet_set_column(summary_worksheet, 4, 4, 15, nullptr); // Ease
+            worksheet_set_column(summary_worksheet, 5, 5, 15, nullptr); // Significance
+            worksheet_set_column(summary_worksheet, 6, 6, 15, nullptr); // Risk
+            worksheet_set_column(summary_worksheet, 7, 7, 60, nullptr); // Statement
+            
+            // Write headers
+            worksheet_write_string(summary_worksheet, 0, 0, "Finding", header_format);
+            worksheet_write_string(summary_worksheet, 0, 1, "File", header_format);
+            worksheet_write_string(summary_worksheet, 0, 2, "Line", header_format);
+            worksheet_write_string(summary_worksheet, 0, 3, "Comments", header_format);
+            worksheet_write_string(summary_worksheet, 0, 4, "Ease", header_format);
+            worksheet_write_string(summary_worksheet, 0, 5, "Significance", header_format);
+            worksheet_write_string(summary_worksheet, 0, 6, "Risk", header_format);
+            worksheet_write_string(summary_worksheet, 0, 7, "Statement", header_format);
+            
+            // Write all findings
+            int row = 1;
+            for (const auto& record : records) {
+                worksheet_write_string(summary_worksheet, row, 0, std::string(record.match()).c_str(), cell_format);  // Actual match
+                worksheet_write_string(summary_worksheet, row, 1, std::string(record.file).c_str(), cell_format);
+                worksheet_write_number(summary_worksheet, row, 2, record.line_number, cell_format);
+                worksheet_write_string(summary_worksheet, row, 3, "", cell_format); // Comments (blank)
+                worksheet_write_string(summary_worksheet, row, 4, "", cell_format); // Ease (blank)
+                worksheet_write_string(summary_worksheet, row, 5, "", cell_format); // Significance (blank)
+                worksheet_write_string(summary_worksheet, row, 6, "", cell_format); // Risk (blank)
+                worksheet_write_string(summary_worksheet, row, 7, std::string(record.statement).c_str(), cell_format);     // Full line
+                row++;
+            }
+            
+            // Freeze the header row so it stays visible when scrolling
+            worksheet_freeze_panes(summary_worksheet, 1, 0);
+            
+            std::cout << "Created Summary sheet with " << records.size() << " total findings" << std::endl;
+        }
+    }
+    
+    // Close workbook
+    lxw_error error = workbook_close(workbook);
+    if (error != LXW_NO_ERROR) {
+        throw std::runtime_error("Failed to save Excel workbook: " + std::string(lxw_strerror(error)));
+    }
+    
+    std::cout << "Successfully created Excel file: " << path << std::endl;
+}
+#endif
+
+// ProgressTracker implementation
+void ProgressTracker::setTotal(int t) {
+    total = t;
+    start_time = std::chrono::steady_clock::now();
+}
+
+void ProgressTracker::addTotal(int n, uint64_t size) {
+    total_final = false;
+    total += n;
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void ProgressTracker::finishTotal() {
+    total_final = true;
+}
+
+void ProgressTracker::increment() {
+    processed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProgressTracker::addBytes(uint64_t n) {
+    bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+void ProgressTracker::finishBytes(uint64_t n) {
+    done_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t ProgressTracker::remainingBytes() const {
+    uint64_t done = done_bytes.load();
+    uint64_t discovered = total_bytes.load();
+    return discovered > done ? discovered - done : 0;
+}
+
+ProgressTracker::~ProgressTracker() {
+    if (reporter.joinable()) {
+        stop();
+    }
+}
+
+void ProgressTracker::start(std::chrono::milliseconds interval) {
+    stopping = false;
+    reporter = std::thread(&ProgressTracker::reportLoop, this, interval);
+}
+
+void ProgressTracker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(reporter_mutex);
+        stopping = true;
+    }
+    reporter_cv.notify_all();
+    if (reporter.joinable()) {
+        reporter.join();
+    }
+    
+    printProgress();
+    if (total_final && total > 0 && processed == total) {
+        std::cout << std::endl << "Processing complete!" << std::endl;
+    }
+}
+
+void ProgressTracker::reportLoop(std::chrono::milliseconds interval) {
+    std::unique_lock<std::mutex> lock(reporter_mutex);
+    while (!reporter_cv.wait_for(lock, interval, [this] { return stopping; })) {
+        printProgress();
+    }
+}
+
+// Only the reporter thread (or stop(), after joining it) prints, so no lock is needed
+void ProgressTracker::printProgress() const {
+    int proc = processed.load();
+    int tot = total.load();
+    bool final = total_final.load();
+    
+    if (tot == 0) return;
+    
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - start_time).count();
+    
+    double percentage = (double)proc / tot * 100.0;
+    int remaining = tot - proc;
+    uint64_t done = done_bytes.load();
+    uint64_t remaining_bytes = remainingBytes();
+    
+    // Estimate time remaining from bytes; file counts say little when sizes vary widely
+    double eta_seconds = 0;
+    if (final && done > 0 && elapsed > 0) {
+        double rate = (double)done / elapsed;
+        eta_seconds = remaining_bytes / rate;
+    }
+    
+    std::cout << "\r[" << std::setw(3) << std::fixed << std::setprecision(1) 
+              << percentage << "%] Processed: " << proc << "/" << tot << (final ? "" : "+")
+              << " | Remaining: " << remaining << " (" << remaining_bytes / (1024.0 * 1024.0) << " MB)";
+    
+    if (elapsed > 0) {
+        std::cout << " | " << proc / elapsed << " files/s"
+                  << " | " << bytes.load() / elapsed / (1024.0 * 1024.0) << " MB/s";
+    }
+    
+    if (eta_seconds > 0) {
+        int eta_min = (int)(eta_seconds / 60);
+        int eta_sec = (int)(eta_seconds) % 60;
+        std::cout << " | ETA: " << eta_min << "m " << eta_sec << "s";
+    }
+    
+    // Clear what is left of a longer previous line
+    std::cout << "   " << std::flush;
+}
+
+// ExpressionProfile implementation
+void ExpressionCost::add(const ExpressionCost& other) {
+    regex_ns += other.regex_ns;
+    bytes += other.bytes;
+    searches += other.searches;
+    matches += other.matches;
+    if (other.worst_ns > worst_ns) {
+        worst_ns = other.worst_ns;
+        worst_file = other.worst_file;
+        worst_offset = other.worst_offset;
+    }
+}
+
+void ExpressionProfile::reset(size_t expression_count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    costs.assign(expression_count, ExpressionCost());
+}
+
+void ExpressionProfile::merge(const std::vector<ExpressionCost>& worker_costs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < worker_costs.size() && i < costs.size(); ++i) {
+        costs[i].add(worker_costs[i]);
+    }
+}
+
+double ExpressionProfile::medianNsPerByte() const {
+    std::vector<double> rates;
+    for (const auto& cost : costs) {
+        if (cost.bytes > 0) {
+            rates.push_back(static_cast<double>(cost.regex_ns) / cost.bytes);
+        }
+    }
+    if (rates.empty()) {
+        return 0;
+    }
+    std::nth_element(rates.begin(), rates.begin() + rates.size() / 2, rates.end());
+    return rates[rates.size() / 2];
+}
+
+// Reasons to suspect an expression of slowing the scan down
+std::vector<std::string> ExpressionProfile::flags(const std::vector<ExpressionPattern>& expressions, size_t index,
+                                                  double median_ns_per_byte) const {
+    std::vector<std::string> reasons;
+    const ExpressionCost& cost = costs[index];
+    
+    if (expressions[index].nested_quantifier) {
+        reasons.push_back("nested quantifier");
+    }
+    if (cost.worst_ns >= SLOW_WINDOW_NS) {
+        reasons.push_back("slow window");
+    }
+    // Only meaningful when there are other expressions to compare against
+    if (cost.bytes > 0 && median_ns_per_byte > 0 && costs.size() > 2) {
+        double ratio = static_cast<double>(cost.regex_ns) / cost.bytes / median_ns_per_byte;
+        if (ratio >= SLOW_FACTOR) {
+            std::ostringstream reason;
+            reason << std::fixed << std::setprecision(0) << ratio << "x median cost per byte";
+            reasons.push_back(reason.str());
+        }
+    }
+    return reasons;
+}
+
+void ExpressionProfile::print(const std::vector<ExpressionPattern>& expressions) const {
+    std::vector<size_t> order;
+    uint64_t total_ns = 0;
+    for (size_t i = 0; i < costs.size() && i < expressions.size(); ++i) {
+        order.push_back(i);
+        total_ns += costs[i].regex_ns;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return costs[a].regex_ns > costs[b].regex_ns;
+    });
+    
+    double median = medianNsPerByte();
+    size_t name_width = 10;
+    for (size_t i : order) {
+        name_width = std::max(name_width, expressions[i].name.size());
+    }
+    
+    std::cout << std::endl << "Expression profile (search time, summed over workers):" << std::endl;
+    std::cout << "  " << std::left << std::setw(static_cast<int>(name_width)) << "expression" << std::right
+              << std::setw(10) << "seconds" << std::setw(8) << "share"
+              << std::setw(10) << "MB" << std::setw(10) << "MB/s"
+              << std::setw(10) << "matches" << std::setw(12) << "worst ms" << std::endl;
+    
+    std::vector<std::string> warnings;
+    for (size_t i : order) {
+        const ExpressionCost& cost = costs[i];
+        double seconds = cost.regex_ns / 1e9;
+        double megabytes = cost.bytes / (1024.0 * 1024.0);
+        
+        std::cout << "  " << std::left << std::setw(static_cast<int>(name_width)) << expressions[i].name << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(10) << seconds
+                  << std::setprecision(1) << std::setw(7) << (total_ns > 0 ? 100.0 * cost.regex_ns / total_ns : 0.0) << "%"
+                  << std::setw(10) << megabytes
+                  << std::setw(10) << (seconds > 0 ? megabytes / seconds : 0.0)
+                  << std::setw(10) << cost.matches
+                  << std::setw(12) << cost.worst_ns / 1e6 << std::endl;
+        
+        std::vector<std::string> reasons = flags(expressions, i, median);
+        if (!reasons.empty()) {
+            std::string warning = "  " + expressions[i].name + ": ";
+            for (size_t r = 0; r < reasons.size(); ++r) {
+                warning += (r > 0 ? ", " : "") + reasons[r];
+            }
+            if (!cost.worst_file.empty()) {
+                warning += " (slowest window at " + cost.worst_file + ":" + std::to_string(cost.worst_offset) + ")";
+            }
+            warnings.push_back(warning);
+        }
+    }
+    
+    if (!warnings.empty()) {
+        std::cout << "Possibly pathological expressions:" << std::endl;
+        for (const auto& warning : warnings) {
+            std::cout << warning << std::endl;
+        }
+    }
+}
+
+bool ExpressionProfile::writeJson(const std::string& path, const std::vector<ExpressionPattern>& expressions) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    double median = medianNsPerByte();
+    std::string out = "{\"expressions\":[";
+    for (size_t i = 0; i < costs.size() && i < expressions.size(); ++i) {
+        const ExpressionCost& cost = costs[i];
+        out += (i > 0) ? ",\n" : "\n";
+        out += "{\"name\":";
+        JsonLinesSink::appendString(out, expressions[i].name);
+        out += ",\"pattern\":";
+        JsonLinesSink::appendString(out, expressions[i].source);
+        out += ",\"regex_ns\":" + std::to_string(cost.regex_ns);
+        out += ",\"bytes\":" + std::to_string(cost.bytes);
+        out += ",\"searches\":" + std::to_string(cost.searches);
+        out += ",\"matches\":" + std::to_string(cost.matches);
+        out += ",\"worst_window_ns\":" + std::to_string(cost.worst_ns);
+        out += ",\"worst_window_file\":";
+        JsonLinesSink::appendString(out, cost.worst_file);
+        out += ",\"worst_window_offset\":" + std::to_string(cost.worst_offset);
+        out += ",\"flags\":[";
+        std::vector<std::string> reasons = flags(expressions, i, median);
+        for (size_t r = 0; r < reasons.size(); ++r) {
+            if (r > 0) out += ',';
+            JsonLinesSink::appendString(out, reasons[r]);
+        }
+        out += "]}";
+    }
+    out += "\n]}\n";
+    
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    return static_cast<bool>(file);
+}
+
+// DirectoryWalker implementation
+#ifdef __linux__
+// Record layout returned by getdents64(2)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+void DirectoryWalker::listDirectory(const std::string& path, uint32_t root, std::vector<std::string>& subdirs) {
+    int dir_fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        std::cerr << "Error accessing directory: " << path << " - " << std::strerror(errno) << std::endl;
+        return;
+    }
+    
+    std::string prefix = (!path.empty() && path.back() == '/') ? path : path + "/";
+    
+    // Classifies one entry; d_type is trusted when the filesystem provides it
+    auto visit = [&](const char* name, unsigned char type) {
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            return;
+        }
+        
+        struct stat st;
+        bool have_stat = false;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            // Symlinks to files are scanned, symlinks to directories are not followed
+            int flags = (type == DT_LNK) ? 0 : AT_SYMLINK_NOFOLLOW;
+            if (::fstatat(dir_fd, name, &st, flags) != 0) {
+                return;
+            }
+            have_stat = true;
+            if (S_ISREG(st.st_mode)) {
+                type = DT_REG;
+            } else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) {
+                type = DT_DIR;
+            } else {
+                return;
+            }
+        }
+        
+        if (type == DT_DIR) {
+            subdirs.push_back(prefix + name);
+        } else if (type == DT_REG) {
+            // The size lets the scheduler start the largest files first
+            if (!have_stat && ::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                st.st_size = 0;
+            }
+            on_file(prefix + name, root, static_cast<uint64_t>(st.st_size));
+        }
+    };
+    
+#ifdef __linux__
+    alignas(8) char buffer[32 * 1024];
+    while (true) {
+        long bytes = ::syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            if (bytes < 0) {
+                std::cerr << "Error reading directory: " << path << " - " << std::strerror(errno) << std::endl;
+            }
+            break;
+        }
+        for (long offset = 0; offset < bytes;) {
+            auto* entry = reinterpret_cast<linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+            visit(entry->d_name, entry->d_type);
+        }
+    }
+    ::close(dir_fd);
+#else
+    DIR* dir = ::fdopendir(dir_fd);
+    if (!dir) {
+        ::close(dir_fd);
+        return;
+    }
+    while (struct dirent* entry = ::readdir(dir)) {
+        visit(entry->d_name, entry->d_type);
+    }
+    ::closedir(dir);
+#endif
+}
+
+void DirectoryWalker::walkerThread() {
+    std::vector<std::string> subdirs;
+    
+    while (true) {
+        std::string path;
+        uint32_t root = 0;
+        {
+            std::unique_lock<std::mutex> lock(dirs_mutex);
+            dirs_cv.wait(lock, [this] { return !pending_dirs.empty() || busy_walkers == 0; });
+            if (pending_dirs.empty()) {
+                break; // Nothing queued and nobody left to queue more
+            }
+            path = std::move(pending_dirs.back().first);
+            root = pending_dirs.back().second;
+            pending_dirs.pop_back();
+            busy_walkers++;
+        }
+        
+        subdirs.clear();
+        listDirectory(path, root, subdirs);
+        
+        {
+            std::lock_guard<std::mutex> lock(dirs_mutex);
+            for (auto& dir : subdirs) {
+                pending_dirs.emplace_back(std::move(dir), root);
+            }
+            busy_walkers--;
+        }
+        dirs_cv.notify_all();
+    }
+}
+
+void DirectoryWalker::walk(const std::vector<std::string>& roots, int num_threads, FileCallback callback) {
+    on_file = std::move(callback);
+    pending_dirs.clear();
+    for (size_t i = 0; i < roots.size(); ++i) {
+        pending_dirs.emplace_back(roots[i], static_cast<uint32_t>(i));
+    }
+    busy_walkers = 0;
+    
+    std::vector<std::thread> walkers;
+    for (int i = 0; i < std::max(1, num_threads); ++i) {
+        walkers.emplace_back(&DirectoryWalker::walkerThread, this);
+    }
+    for (auto& walker : walkers) {
+        walker.join();
+    }
+}
+
+// RegexSyntaxParser implementation
+static bool isWordByte(unsigned char c) {
+    static const std::bitset<256> word_bytes = [] {
+        std::bitset<256> set;
+        for (int b = 0; b < 256; ++b) {
+            if (std::isalnum(b) || b == '_') set.set(b);
+        }
+        return set;
+    }();
+    return word_bytes.test(c);
+}
+
+static std::bitset<256> wordByteSet() {
+    std::bitset<256> set;
+    for (int c = 0; c < 256; ++c) {
+        if (isWordByte(static_cast<unsigned char>(c))) set.set(c);
+    }
+    return set;
+}
+
+static std::bitset<256> digitByteSet() {
+    std::bitset<256> set;
+    for (int c = '0'; c <= '9'; ++c) set.set(c);
+    return set;
+}
+
+static std::bitset<256> spaceByteSet() {
+    std::bitset<256> set;
+    for (int c = 0; c < 256; ++c) {
+        if (std::isspace(static_cast<unsigned char>(c))) set.set(c);
+    }
+    return set;
+}
+
+RegexSyntaxParser::RegexSyntaxParser(const std::string& pattern, bool icase) 
+    : pattern(pattern), icase(icase) {}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parse() {
+    pos = 0;
+    auto root = parseAlternation();
+    if (pos != pattern.size()) {
+        throw std::runtime_error("unexpected ')' at offset " + std::to_string(pos));
+    }
+    return root;
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::makeBytes(std::bitset<256> set) const {
+    if (icase) {
+        for (int c = 'a'; c <= 'z'; ++c) {
+            int upper = c - 'a' + 'A';
+            if (set.test(c) || set.test(upper)) {
+                set.set(c);
+                set.set(upper);
+            }
+        }
+    }
+    auto node = std::make_unique<RegexNode>();
+    node->kind = RegexNode::Kind::Bytes;
+    node->bytes = set;
+    return node;
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseAlternation() {
+    auto first = parseConcatenation();
+    if (pos >= pattern.size() || pattern[pos] != '|') {
+        return first;
+    }
+    
+    auto node = std::make_unique<RegexNode>();
+    node->kind = RegexNode::Kind::Alternate;
+    node->children.push_back(std::move(first));
+    while (pos < pattern.size() && pattern[pos] == '|') {
+        pos++;
+        node->children.push_back(parseConcatenation());
+    }
+    return node;
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseConcatenation() {
+    auto node = std::make_unique<RegexNode>();
+    node->kind = RegexNode::Kind::Concat;
+    while (pos < pattern.size() && pattern[pos] != '|' && pattern[pos] != ')') {
+        node->children.push_back(parseRepeat());
+    }
+    if (node->children.size() == 1) {
+        return std::move(node->children[0]);
+    }
+    if (node->children.empty()) {
+        node->kind = RegexNode::Kind::Empty;
+    }
+    return node;
+}
+
+bool RegexSyntaxParser::parseBound(int& value) {
+    size_t start = pos;
+    value = 0;
+    while (pos < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[pos]))) {
+        value = value * 10 + (pattern[pos] - '0');
+        if (value > 1000) {
+            throw std::runtime_error("repeat bound too large");
+        }
+        pos++;
+    }
+    return pos > start;
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseRepeat() {
+    auto atom = parseAtom();
+    
+    while (pos < pattern.size()) {
+        int min_repeat = 0;
+        int max_repeat = -1;
+        char c = pattern[pos];
+        
+        if (c == '*') {
+            pos++;
+        } else if (c == '+') {
+            min_repeat = 1;
+            pos++;
+        } else if (c == '?') {
+            max_repeat = 1;
+            pos++;
+        } else if (c == '{') {
+            pos++;
+            if (!parseBound(min_repeat)) {
+                throw std::runtime_error("malformed repeat bound");
+            }
+            max_repeat = min_repeat;
+            if (pos < pattern.size() && pattern[pos] == ',') {
+                pos++;
+                if (!parseBound(max_repeat)) {
+                    max_repeat = -1;
+                }
+            }
+            if (pos >= pattern.size() || pattern[pos] != '}') {
+                throw std::runtime_error("malformed repeat bound");
+            }
+            pos++;
+            if (max_repeat != -1 && max_repeat < min_repeat) {
+                throw std::runtime_error("invalid repeat range");
+            }
+        } else {
+            break;
+        }
+        
+        if (atom->kind == RegexNode::Kind::WordBoundary || atom->kind == RegexNode::Kind::NotWordBoundary) {
+            throw std::runtime_error("quantified assertion");
+        }
+        
+        auto repeat = std::make_unique<RegexNode>();
+        repeat->kind = RegexNode::Kind::Repeat;
+        repeat->min_repeat = min_repeat;
+        repeat->max_repeat = max_repeat;
+        if (pos < pattern.size() && pattern[pos] == '?') {
+            repeat->greedy = false;
+            pos++;
+        }
+        repeat->children.push_back(std::move(atom));
+        atom = std::move(repeat);
+    }
+    
+    return atom;
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseAtom() {
+    char c = pattern[pos];
+    
+    switch (c) {
+        case '(': {
+            pos++;
+            if (pos < pattern.size() && pattern[pos] == '?') {
+                if (pos + 1 < pattern.size() && pattern[pos + 1] == ':') {
+                    pos += 2;
+                } else {
+                    throw std::runtime_error("unsupported group type");
+                }
+            }
+            auto node = parseAlternation();
+            if (pos >= pattern.size() || pattern[pos] != ')') {
+                throw std::runtime_error("missing ')'");
+            }
+            pos++;
+            return node;
+        }
+        case '[':
+            pos++;
+            return parseClass();
+        case '.': {
+            pos++;
+            std::bitset<256> set;
+            set.set();
+            set.reset('\n');
+            set.reset('\r');
+            return makeBytes(set);
+        }
+        case '\\':
+            pos++;
+            return parseEscape();
+        case '^':
+        case '$':
+            throw std::runtime_error("anchors are not supported");
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            throw std::runtime_error("nothing to repeat");
+        default: {
+            pos++;
+            std::bitset<256> set;
+            set.set(static_cast<unsigned char>(c));
+            return makeBytes(set);
+        }
+    }
+}
+
+// Parses an escape valid both inside and outside brackets. Returns true for a
+// class escape (\d, \w, \s and negations) stored in set, otherwise stores a single byte.
+bool RegexSyntaxParser::parseClassEscape(std::bitset<256>& set, int& single_byte) {
+    if (pos >= pattern.size()) {
+        throw std::runtime_error("trailing backslash");
+    }
+    
+    char c = pattern[pos++];
+    switch (c) {
+        case 'd': set = digitByteSet(); return true;
+        case 'D': set = ~digitByteSet(); return true;
+        case 'w': set = wordByteSet(); return true;
+        case 'W': set = ~wordByteSet(); return true;
+        case 's': set = spaceByteSet(); return true;
+        case 'S': set = ~spaceByteSet(); return true;
+        case 'n': single_byte = '\n'; return false;
+        case 'r': single_byte = '\r'; return false;
+        case 't': single_byte = '\t'; return false;
+        case 'f': single_byte = '\f'; return false;
+        case 'v': single_byte = '\v'; return false;
+        case '0':
+            if (pos < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[pos]))) {
+                throw std::runtime_error("octal escapes are not supported");
+            }
+            single_byte = 0;
+            return false;
+        case 'x':
+        case 'u': {
+            size_t digits = (c == 'x') ? 2 : 4;
+            if (pos + digits > pattern.size()) {
+                throw std::runtime_error("truncated hex escape");
+            }
+            int value = std::stoi(pattern.substr(pos, digits), nullptr, 16);
+            if (value > 0x7F && c == 'u') {
+                throw std::runtime_error("non-ASCII unicode escape");
+            }
+            pos += digits;
+            single_byte = value;
+            return false;
+        }
+        case 'c':
+            throw std::runtime_error("control escapes are not supported");
+        default:
+            if (c >= '1' && c <= '9') {
+                throw std::runtime_error("back-references are not supported");
+            }
+            single_byte = static_cast<unsigned char>(c);
+            return false;
+    }
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseEscape() {
+    if (pos < pattern.size() && (pattern[pos] == 'b' || pattern[pos] == 'B')) {
+        auto node = std::make_unique<RegexNode>();
+        node->kind = (pattern[pos] == 'b') ? RegexNode::Kind::WordBoundary : RegexNode::Kind::NotWordBoundary;
+        pos++;
+        return node;
+    }
+    
+    std::bitset<256> set;
+    int single_byte = -1;
+    if (!parseClassEscape(set, single_byte)) {
+        set.set(single_byte);
+    }
+    return makeBytes(set);
+}
+
+std::unique_ptr<RegexNode> RegexSyntaxParser::parseClass() {
+    bool negated = false;
+    if (pos < pattern.size() && pattern[pos] == '^') {
+        negated = true;
+        pos++;
+    }
+    
+    std::bitset<256> set;
+    while (true) {
+        if (pos >= pattern.size()) {
+            throw std::runtime_error("missing ']'");
+        }
+        if (pattern[pos] == ']') {
+            pos++;
+            break;
+        }
+        if (pattern[pos] == '[' && pos + 1 < pattern.size() && 
+            (pattern[pos + 1] == ':' || pattern[pos + 1] == '=' || pattern[pos + 1] == '.')) {
+            throw std::runtime_error("POSIX bracket classes are not supported");
+        }
+        
+        // Lower end of a possible range
+        int low = -1;
+        if (pattern[pos] == '\\') {
+            pos++;
+            if (pos < pattern.size() && pattern[pos] == 'b') {
+                pos++;
+                low = '\b';
+            } else {
+                std::bitset<256> class_set;
+                if (parseClassEscape(class_set, low)) {
+                    set |= class_set;
+                    continue;
+                }
+            }
+        } else {
+            low = static_cast<unsigned char>(pattern[pos++]);
+        }
+        
+        // Range a-z, unless the '-' is the last character in the class
+        if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+            pos++;
+            int high = -1;
+            if (pattern[pos] == '\\') {
+                pos++;
+                std::bitset<256> class_set;
+                if (parseClassEscape(class_set, high)) {
+                    throw std::runtime_error("class escape used as range bound");
+                }
+            } else {
+                high = static_cast<unsigned char>(pattern[pos++]);
+            }
+            if (high < low) {
+                throw std::runtime_error("invalid class range");
+            }
+            for (int b = low; b <= high; ++b) {
+                set.set(b);
+            }
+        } else {
+            set.set(low);
+        }
+    }
+    
+    // Case folding is applied before negation so [^a] excludes 'A' as well under icase
+    auto node = makeBytes(set);
+    if (negated) {
+        node->bytes.flip();
+    }
+    return node;
+}
+
+namespace {
+
+// Whether node contains a repeat that can take more than one iteration
+bool containsRepeat(const RegexNode& node) {
+    if (node.kind == RegexNode::Kind::Repeat && (node.max_repeat < 0 || node.max_repeat > 1)) {
+        return true;
+    }
+    for (const auto& child : node.children) {
+        if (containsRepeat(*child)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool hasNestedQuantifier(const RegexNode& node) {
+    if (node.kind == RegexNode::Kind::Repeat && node.max_repeat < 0) {
+        for (const auto& child : node.children) {
+            if (containsRepeat(*child)) return true;
+        }
+    }
+    for (const auto& child : node.children) {
+        if (hasNestedQuantifier(*child)) return true;
+    }
+    return false;
+}
+
+// LiteralPrefilter implementation
+namespace {
+
+const size_t MAX_LITERAL_SET = 16;
+
+// Literal summary of a syntax tree node: the exact (case-folded) strings it can
+// match when that set is small, and a set one of which every match must contain
+struct LiteralInfo {
+    bool exact = false;
+    std::vector<std::string> strings;
+    std::vector<std::string> required;
+};
+
+// Length of the shortest literal; 0 when the set is empty or can match the empty string
+size_t literalScore(const std::vector<std::string>& set) {
+    if (set.empty()) return 0;
+    size_t shortest = set[0].size();
+    for (const auto& literal : set) {
+        shortest = std::min(shortest, literal.size());
+    }
+    return shortest;
+}
+
+void keepBetter(std::vector<std::string>& best, const std::vector<std::string>& candidate) {
+    size_t candidate_score = literalScore(candidate);
+    if (candidate_score == 0) return;
+    size_t best_score = literalScore(best);
+    if (candidate_score > best_score || (candidate_score == best_score && candidate.size() < best.size())) {
+        best = candidate;
+    }
+}
+
+std::vector<std::string> crossProduct(const std::vector<std::string>& left, const std::vector<std::string>& right) {
+    std::vector<std::string> product;
+    for (const auto& a : left) {
+        for (const auto& b : right) {
+            product.push_back(a + b);
+        }
+    }
+    std::sort(product.begin(), product.end());
+    product.erase(std::unique(product.begin(), product.end()), product.end());
+    return product;
+}
+
+LiteralInfo literalInfo(const RegexNode& node) {
+    LiteralInfo info;
+    
+    switch (node.kind) {
+        case RegexNode::Kind::Empty:
+        case RegexNode::Kind::WordBoundary:
+        case RegexNode::Kind::NotWordBoundary:
+            info.exact = true;
+            info.strings = {""};
+            break;
+            
+        case RegexNode::Kind::Bytes: {
+            std::vector<std::string> folded;
+            for (int c = 0; c < 256 && folded.size() <= 4; ++c) {
+                if (!node.bytes.test(c)) continue;
+                std::string literal(1, static_cast<char>(std::tolower(c)));
+                if (std::find(folded.begin(), folded.end(), literal) == folded.end()) {
+                    folded.push_back(literal);
+                }
+            }
+            if (!folded.empty() && folded.size() <= 4) {
+                info.exact = true;
+                info.strings = folded;
+            }
+            break;
+        }
+        
+        case RegexNode::Kind::Concat: {
+            info.exact = true;
+            info.strings = {""};
+            std::vector<std::string> run = {""};
+            
+            for (const auto& child : node.children) {
+                LiteralInfo child_info = literalInfo(*child);
+                if (child_info.exact) {
+                    auto product = crossProduct(run, child_info.strings);
+                    if (product.size() > MAX_LITERAL_SET) {
+                        keepBetter(info.required, run);
+                        run = child_info.strings;
+                    } else {
+                        run = std::move(product);
+                    }
+                    if (info.exact) {
+                        info.strings = crossProduct(info.strings, child_info.strings);
+                        info.exact = info.strings.size() <= MAX_LITERAL_SET;
+                    }
+                } else {
+                    keepBetter(info.required, run);
+                    run = {""};
+                    info.exact = false;
+                }
+                keepBetter(info.required, child_info.required);
+            }
+            keepBetter(info.required, run);
+            if (!info.exact) info.strings.clear();
+            break;
+        }
+        
+        case RegexNode::Kind::Alternate: {
+            info.exact = true;
+            bool all_required = true;
+            for (const auto& child : node.children) {
+                LiteralInfo child_info = literalInfo(*child);
+                if (info.exact && child_info.exact) {
+                    info.strings.insert(info.strings.end(), child_info.strings.begin(), child_info.strings.end());
+                } else {
+                    info.exact = false;
+                }
+                if (literalScore(child_info.required) > 0) {
+                    info.required.insert(info.required.end(), child_info.required.begin(), child_info.required.end());
+                } else {
+                    all_required = false;
+                }
+            }
+            std::sort(info.strings.begin(), info.strings.end());
+            info.strings.erase(std::unique(info.strings.begin(), info.strings.end()), info.strings.end());
+            if (info.strings.size() > MAX_LITERAL_SET) {
+                info.exact = false;
+            }
+            if (!info.exact) info.strings.clear();
+            if (!all_required || info.required.size() > 4 * MAX_LITERAL_SET) {
+                info.required.clear();
+            }
+            break;
+        }
+        
+        case RegexNode::Kind::Repeat: {
+            LiteralInfo child_info = literalInfo(*node.children[0]);
+            if (child_info.exact && node.min_repeat == 0 && node.max_repeat == 1) {
+                info.exact = true;
+                info.strings = child_info.strings;
+                info.strings.push_back("");
+                std::sort(info.strings.begin(), info.strings.end());
+                info.strings.erase(std::unique(info.strings.begin(), info.strings.end()), info.strings.end());
+            } else if (child_info.exact && node.min_repeat == node.max_repeat) {
+                info.exact = true;
+                info.strings = {""};
+                for (int i = 0; i < node.min_repeat && info.exact; ++i) {
+                    info.strings = crossProduct(info.strings, child_info.strings);
+                    info.exact = info.strings.size() <= MAX_LITERAL_SET;
+                }
+                if (!info.exact) info.strings.clear();
+            }
+            if (node.min_repeat >= 1) {
+                keepBetter(info.required, child_info.required);
+            }
+            break;
+        }
+    }
+    
+    if (info.exact) {
+        keepBetter(info.required, info.strings);
+    }
+    return info;
+}
+
+} // namespace
+
+std::vector<std::string> LiteralPrefilter::requiredLiterals(const RegexNode& root) {
+    std::vector<std::string> literals = literalInfo(root).required;
+    
+    // A literal containing another one is redundant: the shorter one already fires
+    std::sort(literals.begin(), literals.end(), [](const std::string& a, const std::string& b) {
+        return a.size() < b.size() || (a.size() == b.size() && a < b);
+    });
+    std::vector<std::string> minimal;
+    for (const auto& literal : literals) {
+        bool redundant = false;
+        for (const auto& kept : minimal) {
+            if (literal.find(kept) != std::string::npos) {
+                redundant = true;
+                break;
+            }
+        }
+        if (!redundant) {
+            minimal.push_back(literal);
+        }
+    }
+    return minimal;
+}
+
+void LiteralPrefilter::build(const std::vector<ExpressionPattern>& expressions) {
+    nodes.assign(1, Node());
+    nodes[0].next.fill(-1);
+    always_candidate.assign(expressions.size(), 0);
+    filtered_count = 0;
+    first_bytes.clear();
+    std::fill(std::begin(first_byte), std::end(first_byte), false);
+    
+    // Trie over the lowercase literals
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        const auto& literals = expressions[i].required_literals;
+        if (literals.empty()) {
+            always_candidate[i] = 1;
+            continue;
+        }
+        filtered_count++;
+        
+        for (const auto& literal : literals) {
+            int state = 0;
+            for (char c : literal) {
+                unsigned char byte = static_cast<unsigned char>(c);
+                if (nodes[state].next[byte] < 0) {
+                    nodes[state].next[byte] = static_cast<int>(nodes.size());
+                    nodes.emplace_back();
+                    nodes.back().next.fill(-1);
+                }
+                state = nodes[state].next[byte];
+            }
+            nodes[state].expressions.push_back(static_cast<int>(i));
+            
+            unsigned char first = static_cast<unsigned char>(literal[0]);
+            first_byte[first] = true;
+            first_byte[std::toupper(first)] = true;
+        }
+    }
+    
+    for (int c = 0; c < 256; ++c) {
+        if (first_byte[c]) first_bytes.push_back(static_cast<unsigned char>(c));
+    }
+    
+    // Breadth-first pass turns the trie into a full DFA with suffix-link outputs merged
+    std::vector<int> fail(nodes.size(), 0);
+    std::queue<int> pending;
+    for (int c = 0; c < 256; ++c) {
+        int child = nodes[0].next[c];
+        if (child < 0) {
+            nodes[0].next[c] = 0;
+        } else {
+            fail[child] = 0;
+            pending.push(child);
+        }
+    }
+    while (!pending.empty()) {
+        int state = pending.front();
+        pending.pop();
+        const auto& inherited = nodes[fail[state]].expressions;
+        nodes[state].expressions.insert(nodes[state].expressions.end(), inherited.begin(), inherited.end());
+        
+        for (int c = 0; c < 256; ++c) {
+            int child = nodes[state].next[c];
+            if (child < 0) {
+                nodes[state].next[c] = nodes[fail[state]].next[c];
+            } else {
+                fail[child] = nodes[fail[state]].next[c];
+                pending.push(child);
+            }
+        }
+    }
+    
+    // Literals are lowercase, so uppercase input follows the same edges
+    for (auto& node : nodes) {
+        for (int c = 'A'; c <= 'Z'; ++c) {
+            node.next[c] = node.next[c - 'A' + 'a'];
+        }
+    }
+}
+
+size_t LiteralPrefilter::filteredCount() const {
+    return filtered_count;
+}
+
+// Advances p to the next byte that can begin a literal, 16 bytes at a time when the
+// set of first bytes is small enough to compare against directly
+const char* LiteralPrefilter::skipToCandidate(const char* p, const char* end) const {
+#ifdef __SSE2__
+    if (!first_bytes.empty() && first_bytes.size() <= 8) {
+        __m128i needles[8];
+        for (size_t i = 0; i < first_bytes.size(); ++i) {
+            needles[i] = _mm_set1_epi8(static_cast<char>(first_bytes[i]));
+        }
+        while (end - p >= 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i found = _mm_setzero_si128();
+            for (size_t i = 0; i < first_bytes.size(); ++i) {
+                found = _mm_or_si128(found, _mm_cmpeq_epi8(block, needles[i]));
+            }
+            int mask = _mm_movemask_epi8(found);
+            if (mask != 0) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+    }
+#endif
+    while (p < end && !first_byte[static_cast<unsigned char>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+void LiteralPrefilter::scan(const char* begin, const char* end, std::vector<char>& candidates) const {
+    size_t remaining = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (i < always_candidate.size() && always_candidate[i]) {
+            candidates[i] = 1;
+        } else if (!candidates[i]) {
+            remaining++;
+        }
+    }
+    
+    int state = 0;
+    const char* p = begin;
+    while (p < end && remaining > 0) {
+        if (state == 0) {
+            p = skipToCandidate(p, end);
+            if (p == end) break;
+        }
+        state = nodes[state].next[static_cast<unsigned char>(*p++)];
+        
+        for (int expr : nodes[state].expressions) {
+            if (!candidates[expr]) {
+                candidates[expr] = 1;
+                remaining--;
+            }
+        }
+    }
+}
+
+// PatternAutomaton implementation
+int PatternAutomaton::addState(State state) {
+    if (states.size() >= 200000) {
+        throw std::runtime_error("automaton too large");
+    }
+    states.push_back(state);
+    return static_cast<int>(states.size() - 1);
+}
+
+// Thompson construction built back to front: returns the entry state of a fragment
+// for node whose accepting edge leads to next
+int PatternAutomaton::compileNode(const RegexNode& node, int next) {
+    switch (node.kind) {
+        case RegexNode::Kind::Empty:
+            return next;
+            
+        case RegexNode::Kind::Bytes: {
+            byte_sets.push_back(node.bytes);
+            State state;
+            state.type = State::Bytes;
+            state.out = next;
+            state.byte_set = static_cast<int>(byte_sets.size() - 1);
+            return addState(state);
+        }
+        
+        case RegexNode::Kind::Concat: {
+            // Reversed, the first child is matched last
+            int entry = next;
+            if (reversed) {
+                for (const auto& child : node.children) {
+                    entry = compileNode(*child, entry);
+                }
+            } else {
+                for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+                    entry = compileNode(**it, entry);
+                }
+            }
+            return entry;
+        }
+        
+        case RegexNode::Kind::Alternate: {
+            int entry = compileNode(*node.children.back(), next);
+            for (size_t i = node.children.size() - 1; i-- > 0;) {
+                State split;
+                split.type = State::Split;
+                split.out = compileNode(*node.children[i], next);
+                split.out1 = entry;
+                entry = addState(split);
+            }
+            return entry;
+        }
+        
+        case RegexNode::Kind::Repeat: {
+            const RegexNode& body = *node.children[0];
+            int entry = next;
+            
+            if (node.max_repeat < 0) {
+                // Loop: split between another iteration and leaving
+                State split;
+                split.type = State::Split;
+                int loop = addState(split);
+                int body_entry = compileNode(body, loop);
+                states[loop].out = node.greedy ? body_entry : next;
+                states[loop].out1 = node.greedy ? next : body_entry;
+                entry = loop;
+            } else {
+                // Optional copies nest as (x(x)?)?
+                for (int i = node.min_repeat; i < node.max_repeat; ++i) {
+                    State split;
+                    split.type = State::Split;
+                    int body_entry = compileNode(body, entry);
+                    split.out = node.greedy ? body_entry : next;
+                    split.out1 = node.greedy ? next : body_entry;
+                    entry = addState(split);
+                }
+            }
+            
+            for (int i = 0; i < node.min_repeat; ++i) {
+                entry = compileNode(body, entry);
+            }
+            return entry;
+        }
+        
+        case RegexNode::Kind::WordBoundary:
+        case RegexNode::Kind::NotWordBoundary: {
+            State state;
+            state.type = (node.kind == RegexNode::Kind::WordBoundary) ? State::WordBoundary : State::NotWordBoundary;
+            state.out = next;
+            return addState(state);
+        }
+    }
+    return next;
+}
+
+// Partitions the byte alphabet into classes that no byte set (or the word/non-word
+// distinction) can tell apart, so DFA transition rows stay small
+void PatternAutomaton::buildByteClasses() {
+    std::vector<int> class_of(256, 0);
+    int count = 1;
+    
+    auto refine = [&](const std::bitset<256>& set) {
+        std::map<std::pair<int, bool>, int> renumber;
+        for (int c = 0; c < 256; ++c) {
+            auto key = std::make_pair(class_of[c], set.test(c));
+            auto it = renumber.find(key);
+            if (it == renumber.end()) {
+                it = renumber.emplace(key, static_cast<int>(renumber.size())).first;
+            }
+            class_of[c] = it->second;
+        }
+        count = static_cast<int>(renumber.size());
+    };
+    
+    refine(wordByteSet());
+    for (const auto& set : byte_sets) {
+        refine(set);
+    }
+    
+    for (int c = 0; c < 256; ++c) {
+        byte_class[c] = static_cast<unsigned char>(class_of[c]);
+    }
+    num_classes = count;
+}
+
+void PatternAutomaton::compile(const std::vector<ExpressionPattern>& expressions, bool reverse, bool verbose) {
+    reversed = reverse;
+    states.clear();
+    byte_sets.clear();
+    start_states.clear();
+    expression_starts.assign(expressions.size(), -1);
+    covered.assign(expressions.size(), 0);
+    covered_count = 0;
+    
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        const auto& expr = expressions[i];
+        if (expr.name.empty()) {
+            continue;
+        }
+        
+        size_t state_mark = states.size();
+        size_t set_mark = byte_sets.size();
+        try {
+            RegexSyntaxParser parser(expr.source, expr.icase);
+            auto root = parser.parse();
+            
+            State match;
+            match.type = State::Match;
+            match.match_id = static_cast<int>(i);
+            int match_state = addState(match);
+            start_states.push_back(compileNode(*root, match_state));
+            expression_starts[i] = start_states.back();
+            
+            covered[i] = 1;
+            covered_count++;
+        } catch (const std::exception& e) {
+            // Roll back the partial fragment; std::regex handles this expression on its own
+            states.resize(state_mark);
+            byte_sets.resize(set_mark);
+            if (verbose && !reversed) {
+                std::cout << "Expression " << expr.name << " not supported by automaton engine (" 
+                          << e.what() << "), using std::regex only" << std::endl;
+            }
+        }
+    }
+    
+    buildByteClasses();
+}
+
+bool PatternAutomaton::covers(size_t expression_index) const {
+    return expression_index < covered.size() && covered[expression_index];
+}
+
+size_t PatternAutomaton::coveredCount() const {
+    return covered_count;
+}
+
+// AutomatonScanner implementation
+AutomatonScanner::AutomatonScanner(const PatternAutomaton& automaton) 
+    : automaton(automaton), visit_mark(automaton.states.size(), 0), expression_of(automaton.states.size(), -1) {
+    // Each expression's fragment is a separate graph reachable from its entry state
+    for (size_t i = 0; i < automaton.expression_starts.size(); ++i) {
+        std::vector<int> stack{automaton.expression_starts[i]};
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            if (s < 0 || expression_of[s] >= 0) {
+                continue;
+            }
+            expression_of[s] = static_cast<int>(i);
+            stack.push_back(automaton.states[s].out);
+            if (automaton.states[s].type == PatternAutomaton::State::Split) {
+                stack.push_back(automaton.states[s].out1);
+            }
+        }
+    }
+}
+
+void AutomatonScanner::beginClosure() {
+    if (++visit_generation == 0) {
+        std::fill(visit_mark.begin(), visit_mark.end(), 0);
+        visit_generation = 1;
+    }
+}
+
+// Follows epsilon edges from state. Word-boundary assertions are kept in the set
+// unresolved unless resolve is set, in which case prev_word/next_word decide them.
+void AutomatonScanner::addClosure(int state, bool resolve, bool prev_word, bool next_word, std::vector<int>& out) {
+    std::vector<int> stack{state};
+    
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (s < 0 || visit_mark[s] == visit_generation) {
+            continue;
+        }
+        visit_mark[s] = visit_generation;
+        
+        const auto& st = automaton.states[s];
+        switch (st.type) {
+            case PatternAutomaton::State::Split:
+                stack.push_back(st.out1);
+                stack.push_back(st.out);
+                break;
+            case PatternAutomaton::State::Epsilon:
+                stack.push_back(st.out);
+                break;
+            case PatternAutomaton::State::WordBoundary:
+            case PatternAutomaton::State::NotWordBoundary:
+                if (!resolve) {
+                    out.push_back(s);
+                } else if ((prev_word != next_word) == (st.type == PatternAutomaton::State::WordBoundary)) {
+                    stack.push_back(st.out);
+                }
+                break;
+            case PatternAutomaton::State::Bytes:
+            case PatternAutomaton::State::Match:
+                out.push_back(s);
+                break;
+        }
+    }
+}
+
+int AutomatonScanner::findOrAddState(std::vector<int> nfa_states, bool prev_word, bool anchored) {
+    std::sort(nfa_states.begin(), nfa_states.end());
+    nfa_states.erase(std::unique(nfa_states.begin(), nfa_states.end()), nfa_states.end());
+    
+    std::vector<int> key = nfa_states;
+    key.push_back(-1 - (prev_word ? 1 : 0) - (anchored ? 2 : 0));
+    auto it = dfa_index.find(key);
+    if (it != dfa_index.end()) {
+        return it->second;
+    }
+    
+    DfaState state;
+    state.nfa_states = std::move(nfa_states);
+    state.prev_word = prev_word;
+    state.anchored = anchored;
+    state.next.assign(automaton.num_classes, -1);
+    
+    // Matches that complete at this position, depending on what the next byte is
+    for (int next_word = 0; next_word < 2; ++next_word) {
+        std::vector<int> resolved;
+        beginClosure();
+        for (int s : state.nfa_states) {
+            addClosure(s, true, prev_word, next_word != 0, resolved);
+        }
+        auto& matches = next_word ? state.matches_next_word : state.matches_next_other;
+        for (int s : resolved) {
+            if (automaton.states[s].type == PatternAutomaton::State::Match) {
+                matches.push_back(automaton.states[s].match_id);
+            }
+        }
+    }
+    
+    dfa.push_back(std::move(state));
+    int index = static_cast<int>(dfa.size() - 1);
+    dfa_index.emplace(std::move(key), index);
+    return index;
+}
+
+int AutomatonScanner::startState(bool prev_word) {
+    std::vector<int> closure;
+    beginClosure();
+    for (int s : automaton.start_states) {
+        addClosure(s, false, false, false, closure);
+    }
+    return findOrAddState(std::move(closure), prev_word, false);
+}
+
+void AutomatonScanner::flush(std::initializer_list<int*> keep) {
+    std::vector<DfaState> kept;
+    for (int* state : keep) {
+        if (*state >= 0) kept.push_back(dfa[*state]);
+    }
+    dfa.clear();
+    dfa_index.clear();
+    
+    size_t next = 0;
+    for (int* state : keep) {
+        if (*state >= 0) {
+            const DfaState& old = kept[next++];
+            *state = findOrAddState(old.nfa_states, old.prev_word, old.anchored);
+        }
+    }
+}
+
+// Builds the transition from current on byte; the caller flushes a full cache first
+int AutomatonScanner::step(int current, unsigned char byte) {
+    bool next_word = isWordByte(byte);
+    const std::vector<int> source = dfa[current].nfa_states;
+    bool prev_word = dfa[current].prev_word;
+    bool anchored = dfa[current].anchored;
+    
+    std::vector<int> resolved;
+    beginClosure();
+    for (int s : source) {
+        addClosure(s, true, prev_word, next_word, resolved);
+    }
+    
+    // Advance every thread that accepts byte, then restart all patterns (unanchored search)
+    std::vector<int> advanced;
+    beginClosure();
+    for (int s : resolved) {
+        const auto& st = automaton.states[s];
+        if (st.type == PatternAutomaton::State::Bytes && automaton.byte_sets[st.byte_set].test(byte)) {
+            addClosure(st.out, false, false, false, advanced);
+        }
+    }
+    if (!anchored) {
+        for (int s : automaton.start_states) {
+            addClosure(s, false, false, false, advanced);
+        }
+    }
+    
+    int next = findOrAddState(std::move(advanced), next_word, anchored);
+    dfa[current].next[automaton.byte_class[byte]] = next;
+    return next;
+}
+
+void AutomatonScanner::scan(const char* begin, const char* end, std::vector<char>& hits,
+                            const char* split, std::vector<char>* live, std::vector<size_t>* ends) {
+    lane = -1;
+    if (automaton.covered_count == 0) {
+        return;
+    }
+    
+    int current = startState();
+    auto advance = [this, &current](int& state, unsigned char byte) {
+        int next = dfa[state].next[automaton.byte_class[byte]];
+        if (next < 0) {
+            if (dfa.size() >= MAX_DFA_STATES) flush({&current, &lane});
+            next = step(state, byte);
+        }
+        state = next;
+    };
+    
+    size_t remaining = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (automaton.covers(i) && !hits[i]) remaining++;
+    }
+    
+    if (ends) {
+        ends->assign(hits.size(), 0);
+    }
+    auto record = [&](const std::vector<int>& matches, const char* p) {
+        for (int id : matches) {
+            if (!hits[id]) {
+                hits[id] = 1;
+                remaining--;
+            }
+            if (ends) {
+                (*ends)[id] = static_cast<size_t>(p - begin);
+            }
+        }
+    };
+    
+    // Past split a second, anchored state follows only the attempts that started before it
+    const char* p = begin;
+    for (; p != end; ++p) {
+        if (p == split) {
+            lane = findOrAddState(dfa[current].nfa_states, dfa[current].prev_word, true);
+        }
+        bool to_split = split && lane < 0;
+        bool searching = remaining > 0 || ends;
+        if (!searching && !to_split && (lane < 0 || dfa[lane].nfa_states.empty())) {
+            break;
+        }
+        
+        unsigned char byte = static_cast<unsigned char>(*p);
+        if (searching || to_split) {
+            const DfaState& state = dfa[current];
+            const auto& matches = isWordByte(byte) ? state.matches_next_word : state.matches_next_other;
+            if (!matches.empty()) {
+                record(matches, p);
+            }
+            advance(current, byte);
+        }
+        if (lane >= 0 && !dfa[lane].nfa_states.empty()) {
+            advance(lane, byte);
+        }
+    }
+    
+    if (p == end) {
+        record(dfa[current].matches_next_other, p);
+    }
+    if (p == end && split == end) {
+        lane = findOrAddState(dfa[current].nfa_states, dfa[current].prev_word, true);
+    }
+    
+    if (live) {
+        live->assign(hits.size(), 0);
+        if (lane >= 0 && p == end) {
+            for (int s : dfa[lane].nfa_states) {
+                if (automaton.states[s].type != PatternAutomaton::State::Match) {
+                    (*live)[expression_of[s]] = 1;
+                }
+            }
+        }
+    }
+}
+
+void AutomatonScanner::scanBackward(const char* begin, const char* end, bool after_word, bool before_word,
+                                    const std::vector<char>& wanted, std::vector<std::vector<uint32_t>>& starts) {
+    lane = -1;
+    int current = startState(after_word);
+    auto record = [&](const std::vector<int>& matches, const char* p) {
+        for (int id : matches) {
+            if (wanted[id]) starts[id].push_back(static_cast<uint32_t>(p - begin));
+        }
+    };
+    
+    // A reversed match ends where the forward one begins, so the byte that decides a
+    // word boundary there is the one before p
+    for (const char* p = end; p != begin; --p) {
+        unsigned char byte = static_cast<unsigned char>(p[-1]);
+        const DfaState& state = dfa[current];
+        const auto& matches = isWordByte(byte) ? state.matches_next_word : state.matches_next_other;
+        if (!matches.empty()) {
+            record(matches, p);
+        }
+        
+        int next = state.next[automaton.byte_class[byte]];
+        if (next < 0) {
+            if (dfa.size() >= MAX_DFA_STATES) flush({&current});
+            next = step(current, byte);
+        }
+        current = next;
+    }
+    record(before_word ? dfa[current].matches_next_word : dfa[current].matches_next_other, begin);
+}
+
+const char* AutomatonScanner::liveUntil(size_t expression_index, const char* p, const char* end) {
+    if (lane < 0) {
+        return p;
+    }
+    std::vector<int> running;
+    for (int s : dfa[lane].nfa_states) {
+        if (expression_of[s] == static_cast<int>(expression_index) && 
+            automaton.states[s].type != PatternAutomaton::State::Match) {
+            running.push_back(s);
+        }
+    }
+    
+    int state = findOrAddState(std::move(running), dfa[lane].prev_word, true);
+    for (; p != end && !dfa[state].nfa_states.empty(); ++p) {
+        int next = dfa[state].next[automaton.byte_class[static_cast<unsigned char>(*p)]];
+        if (next < 0) {
+            if (dfa.size() >= MAX_DFA_STATES) flush({&state, &lane});
+            next = step(state, static_cast<unsigned char>(*p));
+        }
+        state = next;
+    }
+    return p;
+}
+
+// LinearMatcher implementation
+LinearMatcher::LinearMatcher(const PatternAutomaton& automaton) 
+    : automaton(automaton), visit_mark(automaton.states.size(), 0) {}
+
+void LinearMatcher::beginStep() {
+    if (++visit_generation == 0) {
+        std::fill(visit_mark.begin(), visit_mark.end(), 0);
+        visit_generation = 1;
+    }
+}
+
+// Appends the threads reachable from state without consuming input, in priority order.
+// A state already reached in this step is owned by a higher-priority thread.
+void LinearMatcher::addThread(std::vector<Thread>& list, int state, const char* start, bool prev_word, bool next_word) {
+    stack.assign(1, state);
+    
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (s < 0 || visit_mark[s] == visit_generation) {
+            continue;
+        }
+        visit_mark[s] = visit_generation;
+        
+        const auto& st = automaton.states[s];
+        switch (st.type) {
+            case PatternAutomaton::State::Split:
+                stack.push_back(st.out1);
+                stack.push_back(st.out);
+                break;
+            case PatternAutomaton::State::Epsilon:
+                stack.push_back(st.out);
+                break;
+            case PatternAutomaton::State::WordBoundary:
+            case PatternAutomaton::State::NotWordBoundary:
+                if ((prev_word != next_word) == (st.type == PatternAutomaton::State::WordBoundary)) {
+                    stack.push_back(st.out);
+                }
+                break;
+            case PatternAutomaton::State::Bytes:
+            case PatternAutomaton::State::Match:
+                list.push_back(Thread{s, start});
+                break;
+        }
+    }
+}
+
+bool LinearMatcher::find(size_t expression_index, const char* begin, const char* end, bool prev_avail,
+                         const char*& match_begin, const char*& match_end) {
+    const char* live;
+    return search(expression_index, begin, end, end, prev_avail, false, match_begin, match_end, live);
+}
+
+bool LinearMatcher::findOpen(size_t expression_index, const char* begin, const char* attempts_end, const char* end,
+                             bool prev_avail, const char*& match_begin, const char*& match_end, const char*& live) {
+    return search(expression_index, begin, attempts_end, end, prev_avail, true, match_begin, match_end, live);
+}
+
+// Shared by find and findOpen. When open, the byte after end is unknown, so a word
+// boundary there is taken both ways and attempts still running at end are reported in live.
+bool LinearMatcher::search(size_t expression_index, const char* begin, const char* attempts_end, const char* end,
+                           bool prev_avail, bool open, const char*& match_begin, const char*& match_end,
+                           const char*& live) {
+    live = nullptr;
+    if (expression_index >= automaton.expression_starts.size() || automaton.expression_starts[expression_index] < 0) {
+        return false;
+    }
+    const int start_state = automaton.expression_starts[expression_index];
+    
+    bool matched = false;
+    current.clear();
+    beginStep();
+    
+    for (const char* p = begin; ; ++p) {
+        bool prev_word = (p > begin || prev_avail) && isWordByte(static_cast<unsigned char>(p[-1]));
+        bool next_word = p < end && isWordByte(static_cast<unsigned char>(*p));
+        
+        // A new attempt starts here only until something matches, and ranks below every
+        // attempt already running, which started further left
+        if (!matched && (p < attempts_end || attempts_end == end)) {
+            addThread(current, start_state, p, prev_word, next_word);
+        }
+        
+        next.clear();
+        beginStep();
+        for (const Thread& thread : current) {
+            const auto& st = automaton.states[thread.state];
+            if (st.type == PatternAutomaton::State::Match) {
+                matched = true;
+                match_begin = thread.start;
+                match_end = p;
+                break; // Lower-priority threads cannot beat this match
+            }
+            if (p == end) {
+                if (open && !live) {
+                    live = thread.start; // Outranks any match found so far, and may yet match
+                }
+            } else if (automaton.byte_sets[st.byte_set].test(static_cast<unsigned char>(*p))) {
+                bool following_word = p + 1 < end && isWordByte(static_cast<unsigned char>(p[1]));
+                addThread(next, st.out, thread.start, next_word, following_word);
+                if (open && p + 1 == end) {
+                    addThread(next, st.out, thread.start, next_word, true);
+                }
+            }
+        }
+        std::swap(current, next);
+        
+        if (p == end || (matched && current.empty())) {
+            break;
+        }
+    }
+    return matched;
+}
+
+// RegexBudget implementation
+RegexBudget::RegexBudget(uint64_t max_steps, std::chrono::steady_clock::time_point deadline)
+    : max_steps(max_steps), deadline(deadline) {
+    char marker;
+    stack_limit = reinterpret_cast<uintptr_t>(&marker) - MAX_STACK_DEPTH;
+}
+
+void RegexBudget::checkLimits(uintptr_t stack_position) const {
+    if (stack_position < stack_limit) {
+        throw Exceeded("recursion depth limit");
+    }
+    if (steps > max_steps) {
+        throw Exceeded("step limit");
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+        throw Exceeded("time budget");
+    }
+}
+
+// ReadAhead implementation
+const size_t ReadAhead::MAX_DEPTH;
+ReadAhead::ReadAhead(size_t depth) : depth(std::min(std::max<size_t>(1, depth), MAX_DEPTH)) {
+#if USE_IO_URING
+    if (setupRing()) {
+        threads.emplace_back(&ReadAhead::completionThread, this);
+        // Reads the ring refuses go to a few blocking readers, so the completion thread
+        // never stops reaping to read a file itself
+        for (size_t i = 0; i < std::min(this->depth, RING_FALLBACK_READERS); ++i) {
+            threads.emplace_back(&ReadAhead::readerThread, this);
+        }
+        return;
+    }
+#endif
+    // No io_uring (old kernel, seccomp, other OS): one blocking reader per outstanding read
+    for (size_t i = 0; i < this->depth; ++i) {
+        threads.emplace_back(&ReadAhead::readerThread, this);
+    }
+}
+
+ReadAhead::~ReadAhead() {
+    drain();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+#if USE_IO_URING
+        // Wakes the completion thread; nothing else is in flight, so a refused submit
+        // can only be transient
+        while (ring_fd >= 0 && pushSqe(IORING_OP_NOP, nullptr) != 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+#endif
+    }
+    work_cv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#if USE_IO_URING
+    closeRing();
+#endif
+}
+
+void ReadAhead::submit(const std::string& filepath, Completion done) {
+    auto read = std::make_unique<Read>();
+    read->path = filepath;
+    read->done = std::move(done);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    slot_cv.wait(lock, [this] { return outstanding < depth; });
+    outstanding++;
+    
+#if USE_IO_URING
+    if (ring_fd >= 0) {
+        // The open goes through the ring too, so its latency overlaps other files'
+        if (pushSqe(IORING_OP_OPENAT, read.get()) == 0) {
+            read.release();
+            return;
+        }
+        // The ring refused the request; a fallback reader takes it rather than lose the file
+    }
+#endif
+    pending.push_back(std::move(read));
+    lock.unlock();
+    work_cv.notify_one();
+}
+
+void ReadAhead::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    slot_cv.wait(lock, [this] { return outstanding == 0; });
+}
+
+// Opens the file unless the ring already did and sizes its buffer. Returns false with
+// error set on failure.
+bool ReadAhead::openRead(Read& read, int& error) {
+    if (read.fd < 0) {
+        read.fd = ::open(read.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (read.fd < 0) {
+            error = errno;
+            return false;
+        }
+    }
+    struct stat st;
+    if (::fstat(read.fd, &st) != 0) {
+        error = errno;
+        return false;
+    }
+    read.data.resize(static_cast<size_t>(st.st_size));
+    return true;
+}
+
+// Hands the result over and frees the slot. A failed read delivers no bytes.
+void ReadAhead::finish(Read* read, int error) {
+    std::unique_ptr<Read> owned(read);
+    if (owned->fd >= 0) {
+        ::close(owned->fd);
+    }
+    if (error != 0) {
+        owned->data.clear();
+    } else {
+        owned->data.resize(owned->filled);
+    }
+    owned->done(std::move(owned->data), error);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+#if USE_IO_URING
+        in_ring.erase(read);
+#endif
+        outstanding--;
+    }
+    slot_cv.notify_all();
+}
+
+void ReadAhead::readerThread() {
+    while (true) {
+        std::unique_ptr<Read> read;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [this] { return !pending.empty() || stopping; });
+            if (pending.empty()) {
+                return;
+            }
+            read = std::move(pending.front());
+            pending.pop_front();
+        }
+        
+        int error = readBlocking(*read);
+        finish(read.release(), error);
+    }
+}
+
+// Opens and sizes the file if nothing has been read yet and reads whatever is still missing
+int ReadAhead::readBlocking(Read& read) {
+    int error = 0;
+    if (read.filled == 0 && !openRead(read, error)) {
+        return error;
+    }
+    while (read.filled < read.data.size()) {
+        ssize_t got = ::pread(read.fd, read.data.data() + read.filled, 
+                              read.data.size() - read.filled, static_cast<off_t>(read.filled));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            return errno;
+        }
+        if (got == 0) {
+            break; // Shrank since it was opened
+        }
+        read.filled += static_cast<size_t>(got);
+    }
+    return 0;
+}
+
+#if USE_IO_URING
+bool ReadAhead::setupRing() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+    if (fd < 0) {
+        return false;
+    }
+    ring_fd = fd;
+    
+    // Opens and statx go through the ring too (Linux 5.6); older kernels use reader threads
+    const unsigned probe_ops = 256;
+    std::vector<uint64_t> probe_buffer((sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op)) / sizeof(uint64_t), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+    if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, probe_ops) < 0) {
+        closeRing();
+        return false;
+    }
+    for (unsigned opcode : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READV}) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            closeRing();
+            return false;
+        }
+    }
+    
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    
+    sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                     ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        closeRing();
+        return false;
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                         ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            closeRing();
+            return false;
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_map = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                            ring_fd, IORING_OFF_SQES);
+    if (sqes_map == MAP_FAILED) {
+        closeRing();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_map);
+    
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void ReadAhead::closeRing() {
+    if (sqes) {
+        ::munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        ::munmap(cq_ring, cq_ring_size);
+    }
+    cq_ring = nullptr;
+    if (sq_ring) {
+        ::munmap(sq_ring, sq_ring_size);
+        sq_ring = nullptr;
+    }
+    if (ring_fd >= 0) {
+        ::close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+// Queues one request and submits it. At most depth reads plus the final NOP are ever
+// outstanding, so the submission ring (depth entries, each consumed on submit) never fills.
+// If the kernel refuses the submit (EAGAIN, EBUSY, ENOMEM, ...) the entry is taken back
+// off the ring, so it can never complete later, and the errno is returned.
+int ReadAhead::pushSqe(uint8_t opcode, Read* read) {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = reinterpret_cast<uint64_t>(read);
+    if (opcode == IORING_OP_OPENAT) {
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(read->path.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    } else if (opcode == IORING_OP_STATX) {
+        sqe->fd = read->fd;
+        sqe->addr = reinterpret_cast<uint64_t>("");
+        sqe->len = STATX_SIZE;
+        sqe->off = reinterpret_cast<uint64_t>(&read->stx);
+        sqe->statx_flags = AT_EMPTY_PATH;
+    } else if (opcode == IORING_OP_READV) {
+        read->iov.iov_base = read->data.data() + read->filled;
+        read->iov.iov_len = read->data.size() - read->filled;
+        sqe->fd = read->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&read->iov);
+        sqe->len = 1;
+        sqe->off = read->filled;
+    }
+    if (read) {
+        read->opcode = opcode;
+    }
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    
+    long submitted;
+    do {
+        submitted = ::syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0);
+    } while (submitted < 0 && errno == EINTR);
+    
+    // Only io_uring_enter consumes entries and every caller holds mutex, so an entry
+    // it refused is still unconsumed and the tail can be rewound
+    if (submitted != 1 && __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == tail) {
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        return (submitted < 0) ? errno : EAGAIN;
+    }
+    
+    // Submitted, or consumed after all; its completion will arrive
+    if (read) {
+        in_ring.insert(read);
+    }
+    return 0;
+}
+
+// Queues the next request of a read, handing it to a fallback reader if the ring refuses it
+void ReadAhead::resubmit(Read* read, uint8_t opcode) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_ring.erase(read);
+        if (ring_fd >= 0 && pushSqe(opcode, read) == 0) {
+            return;
+        }
+        pending.emplace_back(read);
+    }
+    work_cv.notify_one();
+}
+
+// The ring can no longer be reaped. It is closed so submit() stops using it, and every
+// read it held restarts from scratch on a fallback reader. The kernel may still write
+// into those reads' buffers, so they are left allocated; only the path, completion and
+// any opened fd move to the fresh read.
+void ReadAhead::abandonRing() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeRing();
+        for (Read* stranded : in_ring) {
+            auto read = std::make_unique<Read>();
+            read->path = stranded->path;
+            read->done = std::move(stranded->done);
+            read->fd = stranded->fd;
+            pending.push_back(std::move(read));
+        }
+        in_ring.clear();
+    }
+    work_cv.notify_all();
+    slot_cv.notify_all();
+}
+
+// Reaps completions, moving each file from open to statx to reads and resubmitting
+// short reads until it is complete
+void ReadAhead::completionThread() {
+    bool stop = false;
+    while (!stop) {
+        if (::syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+            std::cerr << "Error waiting for io_uring completions: " << std::strerror(errno) 
+                      << "; finishing reads without io_uring" << std::endl;
+            abandonRing();
+            break;
+        }
+        
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            Read* read = reinterpret_cast<Read*>(cqe.user_data);
+            int res = cqe.res;
+            __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+            
+            if (!read) {
+                stop = true; // The NOP queued by the destructor
+            } else if (res == -EINTR || res == -EAGAIN) {
+                resubmit(read, read->opcode);
+            } else if (res < 0) {
+                finish(read, -res);
+            } else if (read->opcode == IORING_OP_OPENAT) {
+                read->fd = res;
+                resubmit(read, IORING_OP_STATX);
+            } else if (read->opcode == IORING_OP_STATX) {
+                read->data.resize(static_cast<size_t>(read->stx.stx_size));
+                if (read->data.empty()) {
+                    finish(read, 0);
+                } else {
+                    resubmit(read, IORING_OP_READV);
+                }
+            } else if (res == 0) {
+                finish(read, 0); // Shrank since it was opened
+            } else {
+                read->filled += static_cast<size_t>(res);
+                if (read->filled < read->data.size()) {
+                    resubmit(read, IORING_OP_READV);
+                } else {
+                    finish(read, 0);
+                }
+            }
+        }
+    }
+}
+#endif
+
+// MappedFile implementation
+MappedFile::MappedFile(const std::string& filepath, bool require_settled) {
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && 
+        (!require_settled || st.st_mtime < ::time(nullptr) - SETTLE_SECONDS)) {
+        if (st.st_size == 0) {
+            mapped = true; // Nothing to map, but nothing to stream either
+        } else {
+            void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                bytes = static_cast<const char*>(addr);
+                length = static_cast<size_t>(st.st_size);
+                mapped = true;
+            }
+        }
+    }
+    
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) {
+        ::munmap(const_cast<char*>(bytes), length);
+    }
+}
+
+bool MappedFile::isMapped() const {
+    return mapped;
+}
+
+const char* MappedFile::data() const {
+    return bytes;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+// LineIndex implementation
+void LineIndex::build(const char* begin, const char* end) {
+    newlines.clear();
+    segment_size = static_cast<size_t>(end - begin);
+    const char* p = begin;
+    
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        while (mask != 0) {
+            newlines.push_back(static_cast<size_t>(p - begin) + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            newlines.push_back(static_cast<size_t>(p - begin));
+        }
+    }
+}
+
+size_t LineIndex::newlinesBefore(size_t offset) const {
+    return static_cast<size_t>(std::lower_bound(newlines.begin(), newlines.end(), offset) - newlines.begin());
+}
+
+size_t LineIndex::lineStart(size_t offset) const {
+    size_t line = newlinesBefore(offset);
+    return (line == 0) ? 0 : newlines[line - 1] + 1;
+}
+
+size_t LineIndex::lineEnd(size_t offset) const {
+    auto it = std::lower_bound(newlines.begin(), newlines.end(), offset);
+    return (it == newlines.end()) ? segment_size : *it;
+}
+
+// FindingArena implementation
+void FindingArena::push_back(Finding&& finding) {
+    if (count % CHUNK_SIZE == 0) {
+        chunks.emplace_back();
+        chunks.back().reserve(CHUNK_SIZE);
+    }
+    chunks.back().push_back(std::move(finding));
+    count++;
+}
+
+void FindingArena::truncate(size_t new_count) {
+    if (new_count >= count) {
+        return;
+    }
+    chunks.resize((new_count + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    if (!chunks.empty()) {
+        chunks.back().resize(new_count - (chunks.size() - 1) * CHUNK_SIZE);
+    }
+    count = new_count;
+}
+
+// FindingShards implementation
+FindingShards::const_iterator::const_iterator(const std::vector<FindingArena>* shards, size_t shard)
+    : shards(shards), shard(shard), 
+      position(shard < shards->size() ? (*shards)[shard].begin() : FindingArena::const_iterator(nullptr, 0)) {
+    skipExhausted();
+}
+
+void FindingShards::const_iterator::skipExhausted() {
+    while (shard < shards->size() && position == (*shards)[shard].end()) {
+        ++shard;
+        position = (shard < shards->size()) ? (*shards)[shard].begin() : FindingArena::const_iterator(nullptr, 0);
+    }
+}
+
+FindingShards::const_iterator& FindingShards::const_iterator::operator++() {
+    ++position;
+    skipExhausted();
+    return *this;
+}
+
+bool FindingShards::const_iterator::operator==(const const_iterator& other) const {
+    if (shard != other.shard) {
+        return false;
+    }
+    return shard == shards->size() || position == other.position;
+}
+
+void FindingShards::reset(size_t shard_count) {
+    shards.clear();
+    shards.resize(shard_count);
+}
+
+size_t FindingShards::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        total += shard.size();
+    }
+    return total;
+}
+
+// ScanCache implementation
+namespace {
+
+const char CACHE_MAGIC[8] = {'W', 'H', 'S', 'T', 'C', 'A', 'C', 'H'};
+// One cached Finding on disk: every field save() writes, which is all but file_id
+const size_t FINDING_RECORD_SIZE = sizeof(Finding::expression_id) + sizeof(Finding::line_number) + 
+                                   sizeof(Finding::match_offset) + sizeof(Finding::match_length) + 
+                                   sizeof(Finding::statement_length) + sizeof(Finding::statement_offset);
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void writeBytes(std::ostream& out, const std::string& bytes) {
+    writeValue(out, static_cast<uint64_t>(bytes.size()));
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+} // namespace
+
+bool ScanCache::fileKey(const std::string& filepath, FileKey& key) {
+    struct stat st;
+    if (::stat(filepath.c_str(), &st) != 0) {
+        return false;
+    }
+    key.size = static_cast<uint64_t>(st.st_size);
+    key.mtime_ns = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + 
+                   static_cast<uint64_t>(st.st_mtim.tv_nsec);
+    key.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+bool ScanCache::load(const std::string& cache_path, uint64_t hash, size_t expression_count) {
+    expression_hash = hash;
+    previous.clear();
+    current.clear();
+    
+    MappedFile mapped(cache_path);
+    if (!mapped.isMapped()) {
+        return false;
+    }
+    
+    // Every length is checked against the bytes left before anything is allocated
+    ByteReader in(mapped.data(), mapped.size());
+    char magic[sizeof(CACHE_MAGIC)];
+    uint64_t stored_hash = 0;
+    uint64_t entry_count = 0;
+    if (!in.read(magic) || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !in.read(stored_hash) || !in.read(entry_count)) {
+        std::cerr << "Warning: Ignoring unrecognised scan cache: " << cache_path << std::endl;
+        return false;
+    }
+    if (stored_hash != hash) {
+        return false; // Written for a different expression set
+    }
+    
+    for (uint64_t i = 0; i < entry_count; ++i) {
+        std::string path;
+        Entry entry;
+        uint8_t is_text = 0;
+        uint64_t finding_count = 0;
+        
+        bool valid = in.readString(path) && in.read(entry.key.size) && 
+                     in.read(entry.key.mtime_ns) && in.read(entry.key.inode) && 
+                     in.read(is_text) && in.readString(entry.lines) && 
+                     in.read(finding_count) && finding_count <= in.remaining() / FINDING_RECORD_SIZE;
+        
+        if (valid) {
+            entry.is_text = (is_text != 0);
+            entry.findings.resize(static_cast<size_t>(finding_count));
+            for (Finding& finding : entry.findings) {
+                finding.file_id = 0;
+                valid = in.read(finding.expression_id) && finding.expression_id < expression_count &&
+                        in.read(finding.line_number) &&
+                        in.read(finding.match_offset) && in.read(finding.match_length) &&
+                        in.read(finding.statement_length) && in.read(finding.statement_offset) &&
+                        finding.statement_offset <= entry.lines.size() &&
+                        finding.statement_length <= entry.lines.size() - finding.statement_offset &&
+                        finding.match_offset <= finding.statement_length &&
+                        finding.match_length <= finding.statement_length - finding.match_offset;
+                if (!valid) {
+                    break;
+                }
+            }
+        }
+        
+        if (!valid) {
+            std::cerr << "Warning: Ignoring truncated or corrupt scan cache: " << cache_path << std::endl;
+            previous.clear();
+            return false;
+        }
+        
+        previous[path] = std::move(entry);
+    }
+    
+    return true;
+}
+
+bool ScanCache::take(const std::string& filepath, const FileKey& key, Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto cached = previous.find(filepath);
+    if (cached == previous.end()) {
+        return false;
+    }
+    
+    bool unchanged = (cached->second.key == key);
+    if (unchanged) {
+        entry = std::move(cached->second);
+    }
+    previous.erase(cached);
+    return unchanged;
+}
+
+bool ScanCache::has(const std::string& filepath) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return previous.count(filepath) != 0;
+}
+
+void ScanCache::record(const std::string& filepath, const FileKey& key, bool is_text, int64_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    current.push_back(Record{filepath, key, is_text, file_id});
+}
+
+bool ScanCache::save(const std::string& cache_path, const std::deque<FileRecord>& files, 
+                     const FindingShards& findings) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // Findings grouped by file, in the order they were recorded
+    std::vector<std::vector<const Finding*>> by_file(files.size());
+    for (const auto& finding : findings) {
+        by_file[finding.file_id].push_back(&finding);
+    }
+    
+    // Written beside the target and renamed over it, so a failed write keeps the old cache
+    std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        
+        out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        writeValue(out, expression_hash);
+        writeValue(out, static_cast<uint64_t>(current.size()));
+        
+        static const std::string no_lines;
+        static const std::vector<const Finding*> no_findings;
+        
+        for (const Record& record : current) {
+            bool has_findings = record.file_id >= 0;
+            const std::string& lines = has_findings ? files[static_cast<size_t>(record.file_id)].lines : no_lines;
+            const auto& file_findings = has_findings ? by_file[static_cast<size_t>(record.file_id)] : no_findings;
+            
+            writeBytes(out, record.path);
+            writeValue(out, record.key.size);
+            writeValue(out, record.key.mtime_ns);
+            writeValue(out, record.key.inode);
+            writeValue(out, static_cast<uint8_t>(record.is_text ? 1 : 0));
+            writeBytes(out, lines);
+            writeValue(out, static_cast<uint64_t>(file_findings.size()));
+            
+            for (const Finding* finding : file_findings) {
+                writeValue(out, finding->expression_id);
+                writeValue(out, finding->line_number);
+                writeValue(out, finding->match_offset);
+                writeValue(out, finding->match_length);
+                writeValue(out, finding->statement_length);
+                writeValue(out, finding->statement_offset);
+            }
+        }
+        
+        out.flush();
+        if (!out.good()) {
+            out.close();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    
+    if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ExpressionPattern implementation
+ExpressionPattern::ExpressionPattern(std::string name, std::string source, bool icase)
+    : name(std::move(name)), source(std::move(source)), icase(icase) {}
+
+const std::regex& ExpressionPattern::regex() const {
+    std::call_once(*compile_once, [this] {
+        auto flags = std::regex_constants::ECMAScript;
+        if (icase) {
+            flags |= std::regex_constants::icase;
+        }
+        pattern = std::regex(source, flags);
+    });
+    return pattern;
+}
+
+// PatternCache implementation
+namespace {
+
+const char PATTERN_CACHE_MAGIC[8] = {'W', 'H', 'S', 'T', 'P', 'A', 'T', 'S'};
+
+template <typename T>
+void writeVector(std::ostream& out, const std::vector<T>& values) {
+    writeValue(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+} // namespace
+
+bool ByteReader::readString(std::string& text) {
+    uint64_t size;
+    if (!read(size) || size > static_cast<size_t>(end - position)) {
+        return false;
+    }
+    text.assign(position, static_cast<size_t>(size));
+    position += size;
+    return true;
+}
+
+void LiteralPrefilter::save(std::ostream& out) const {
+    writeValue(out, static_cast<uint64_t>(nodes.size()));
+    for (const Node& node : nodes) {
+        out.write(reinterpret_cast<const char*>(node.next.data()), sizeof(node.next));
+        writeVector(out, node.expressions);
+    }
+    writeVector(out, always_candidate);
+    writeValue(out, static_cast<uint64_t>(filtered_count));
+    writeVector(out, first_bytes);
+}
+
+bool LiteralPrefilter::load(ByteReader& in) {
+    uint64_t node_count = 0;
+    uint64_t filtered = 0;
+    if (!in.read(node_count) || node_count == 0 || node_count > INT32_MAX) {
+        return false;
+    }
+    
+    nodes.clear();
+    for (uint64_t i = 0; i < node_count; ++i) {
+        Node node;
+        if (!in.read(node.next) || !in.readVector(node.expressions)) {
+            return false;
+        }
+        for (int next : node.next) {
+            if (next < 0 || static_cast<uint64_t>(next) >= node_count) return false;
+        }
+        nodes.push_back(std::move(node));
+    }
+    if (!in.readVector(always_candidate) || !in.read(filtered) || !in.readVector(first_bytes)) {
+        return false;
+    }
+    for (const Node& node : nodes) {
+        for (int id : node.expressions) {
+            if (id < 0 || static_cast<size_t>(id) >= always_candidate.size()) return false;
+        }
+    }
+    
+    filtered_count = static_cast<size_t>(filtered);
+    std::fill(std::begin(first_byte), std::end(first_byte), false);
+    for (unsigned char c : first_bytes) {
+        first_byte[c] = true;
+    }
+    return true;
+}
+
+void PatternAutomaton::save(std::ostream& out) const {
+    writeVector(out, states);
+    writeVector(out, byte_sets);
+    writeVector(out, start_states);
+    writeVector(out, expression_starts);
+    writeVector(out, covered);
+    out.write(reinterpret_cast<const char*>(byte_class), sizeof(byte_class));
+    writeValue(out, static_cast<int32_t>(num_classes));
+}
+
+bool PatternAutomaton::load(ByteReader& in, size_t expression_count) {
+    int32_t classes = 0;
+    if (!in.readVector(states) || !in.readVector(byte_sets) || !in.readVector(start_states) ||
+        !in.readVector(expression_starts) || !in.readVector(covered) || 
+        !in.read(byte_class) || !in.read(classes)) {
+        return false;
+    }
+    
+    // Every index is checked so a damaged cache cannot send a scanner out of bounds
+    auto valid_state = [this](int state) { return state >= -1 && state < static_cast<int>(states.size()); };
+    for (const State& state : states) {
+        bool valid = valid_state(state.out) && valid_state(state.out1) && state.type <= State::Match &&
+                     (state.type != State::Bytes || (state.byte_set >= 0 && static_cast<size_t>(state.byte_set) < byte_sets.size())) &&
+                     (state.type != State::Match || (state.match_id >= 0 && static_cast<size_t>(state.match_id) < expression_count));
+        if (!valid) return false;
+    }
+    for (int start : start_states) {
+        if (start < 0 || !valid_state(start)) return false;
+    }
+    for (int start : expression_starts) {
+        if (!valid_state(start)) return false;
+    }
+    for (unsigned char byte_class_id : byte_class) {
+        if (byte_class_id >= classes) return false;
+    }
+    if (expression_starts.size() != expression_count || covered.size() != expression_count || classes < 1) {
+        return false;
+    }
+    
+    num_classes = classes;
+    covered_count = static_cast<size_t>(std::count(covered.begin(), covered.end(), 1));
+    return true;
+}
+
+bool PatternCache::propertiesHash(const std::string& properties_path, uint64_t& hash) {
+    MappedFile properties(properties_path);
+    std::string contents;
+    std::string_view bytes;
+    if (properties.isMapped()) {
+        bytes = std::string_view(properties.data(), properties.size());
+    } else {
+        std::ifstream file(properties_path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = contents;
+    }
+    
+    // The layout sizes change with the compiler and platform the cache was written on
+    const uint64_t CACHE_FORMAT_VERSION = 2;   // 2: adds the reversed automaton
+    const uint64_t layout[] = {CACHE_FORMAT_VERSION, sizeof(PatternAutomaton::State), sizeof(std::bitset<256>), sizeof(int)};
+    hash = 14695981039346656037ULL; // FNV-1a
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    mix(layout, sizeof(layout));
+    mix(bytes.data(), bytes.size());
+    return true;
+}
+
+bool PatternCache::load(const std::string& cache_path, uint64_t hash, std::vector<ExpressionPattern>& expressions,
+                        LiteralPrefilter& prefilter, PatternAutomaton& automaton, PatternAutomaton& reverse_automaton) {
+    MappedFile mapped(cache_path);
+    if (!mapped.isMapped()) {
+        return false;
+    }
+    
+    ByteReader in(mapped.data(), mapped.size());
+    char magic[sizeof(PATTERN_CACHE_MAGIC)];
+    uint64_t stored_hash = 0;
+    uint64_t count = 0;
+    if (!in.read(magic) || std::memcmp(magic, PATTERN_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !in.read(stored_hash) || !in.read(count)) {
+        std::cerr << "Warning: Ignoring unrecognised pattern cache: " << cache_path << std::endl;
+        return false;
+    }
+    if (stored_hash != hash) {
+        return false; // Written for another properties file
+    }
+    
+    std::vector<ExpressionPattern> loaded;
+    bool valid = count > 0 && count <= UINT32_MAX;
+    for (uint64_t i = 0; valid && i < count; ++i) {
+        std::string name;
+        std::string source;
+        uint8_t icase = 0;
+        uint8_t nested = 0;
+        uint64_t literal_count = 0;
+        valid = in.readString(name) && in.readString(source) && in.read(icase) && in.read(nested) &&
+                in.read(literal_count) && literal_count <= mapped.size();
+        if (!valid) {
+            break;
+        }
+        
+        loaded.emplace_back(std::move(name), std::move(source), icase != 0);
+        loaded.back().nested_quantifier = (nested != 0);
+        loaded.back().required_literals.resize(static_cast<size_t>(literal_count));
+        for (auto& literal : loaded.back().required_literals) {
+            valid = valid && in.readString(literal);
+        }
+    }
+    
+    valid = valid && prefilter.load(in) && automaton.load(in, loaded.size()) && 
+            reverse_automaton.load(in, loaded.size()) && in.atEnd();
+    for (size_t i = 0; valid && i < loaded.size(); ++i) {
+        valid = (automaton.covers(i) == reverse_automaton.covers(i));
+    }
+    if (!valid) {
+        std::cerr << "Warning: Ignoring truncated or corrupt pattern cache: " << cache_path << std::endl;
+        return false;
+    }
+    
+    expressions = std::move(loaded);
+    return true;
+}
+
+bool PatternCache::save(const std::string& cache_path, uint64_t hash, const std::vector<ExpressionPattern>& expressions,
+                        const LiteralPrefilter& prefilter, const PatternAutomaton& automaton,
+                        const PatternAutomaton& reverse_automaton) {
+    // Written aside and renamed so a concurrent run never maps a half-written cache
+    std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        
+        out.write(PATTERN_CACHE_MAGIC, sizeof(PATTERN_CACHE_MAGIC));
+        writeValue(out, hash);
+        writeValue(out, static_cast<uint64_t>(expressions.size()));
+        for (const auto& expr : expressions) {
+            writeBytes(out, expr.name);
+            writeBytes(out, expr.source);
+            writeValue(out, static_cast<uint8_t>(expr.icase));
+            writeValue(out, static_cast<uint8_t>(expr.nested_quantifier));
+            writeValue(out, static_cast<uint64_t>(expr.required_literals.size()));
+            for (const auto& literal : expr.required_literals) {
+                writeBytes(out, literal);
+            }
+        }
+        prefilter.save(out);
+        automaton.save(out);
+        reverse_automaton.save(out);
+        
+        if (!out) {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+}
+
+// RegexAnalyzer implementation
+const size_t RegexAnalyzer::TEXT_SAMPLE_SIZE;
+const size_t RegexAnalyzer::CHUNK_SIZE;
+const uint64_t RegexAnalyzer::MIN_REGEX_STEPS;
+std::vector<ExpressionPattern> RegexAnalyzer::loadExpressions(const std::string& filename) {
+    std::vector<ExpressionPattern> patterns;
+    std::ifstream file(filename);
+    
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open expressions.properties file");
+    }
+    
+    std::string line;
+    bool in_expressions_section = false;
+    
+    while (std::getline(file, line)) {
+        // Trim whitespace
+        line.erase(0, line.find_first_not_of(" \t\r\n"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        
+        // Skip empty lines and comments
+        if (line.empty() || line[0] == '#') continue;
+        
+        // Check for [expressions] section
+        if (line == "[expressions]") {
+            in_expressions_section = true;
+            continue;
+        }
+        
+        // Check for other sections
+        if (line[0] == '[' && line.back() == ']') {
+            in_expressions_section = false;
+            continue;
+        }
+        
+        if (in_expressions_section) {
+            // Parse expression.name=pattern
+            size_t eq_pos = line.find('=');
+            if (eq_pos != std::string::npos) {
+                std::string key = line.substr(0, eq_pos);
+                std::string value = line.substr(eq_pos + 1);
+                
+                // Trim key and value
+                key.erase(0, key.find_first_not_of(" \t"));
+                key.erase(key.find_last_not_of(" \t") + 1);
+                value.erase(0, value.find_first_not_of(" \t"));
+                value.erase(value.find_last_not_of(" \t") + 1);
+                
+                if (key.substr(0, 11) == "expression.") {
+                    std::string expr_name = key.substr(11);
                     try {
                         // Check for inline flags like (?i) at the beginning
-                        std::regex_constants::syntax_option_type flags = std::regex_constants::ECMAScript;
                         std::string pattern_str = value;
+                        bool icase = true;
                         
                         // Handle (?i) case-insensitive flag
                         if (pattern_str.substr(0, 4) == "(?i)") {
-                            flags |= std::regex_constants::icase;
                             pattern_str = pattern_str.substr(4); // Remove (?i) from pattern
                         }
                         // Handle (?-i) case-sensitive flag (explicit)
                         else if (pattern_str.substr(0, 5) == "(?-i)") {
                             // Default is case-sensitive, so just remove the flag
                             pattern_str = pattern_str.substr(5); // Remove (?-i) from pattern
+                            icase = false;
                         }
-                        // Default case-insensitive behavior (as originally implemented)
-                        else {
-                            flags |= std::regex_constants::icase;
+                        // Otherwise case-insensitive (as originally implemented)
+                        
+                        // Compiled here so invalid patterns are reported and dropped up front
+                        ExpressionPattern pattern(expr_name, pattern_str, icase);
+                        pattern.regex();
+                        patterns.push_back(std::move(pattern));
+                        if (verbose) {
+                            std::cout << "Loaded expression: " << expr_name << " = " << value << std::endl;
                         }
                         
-                        std::regex pattern(pattern_str, flags);
-                        patterns.push_back({expr_name, std::move(pattern)});
-                        std::cout << "Loaded expression: " << expr_name << " = " << value << std::endl;
+                        // Literals for the prefilter; syntax the parser cannot represent gets none
+                        try {
+                            RegexSyntaxParser parser(pattern_str, icase);
+                            auto root = parser.parse();
+                            patterns.back().required_literals = LiteralPrefilter::requiredLiterals(*root);
+                            patterns.back().nested_quantifier = hasNestedQuantifier(*root);
+                        } catch (const std::runtime_error&) {
+                            patterns.back().required_literals.clear();
+                        }
                     } catch (const std::regex_error& e) {
                         std::cerr << "Invalid regex for " << expr_name << ": " << value 
                                  << " Error: " << e.what() << std::endl;
@@ -321,630 +3467,1701 @@ std::vector<ExpressionPattern> RegexAnalyzer::loadExpressions(const std::string&
         }
     }
     
-    return patterns;
+    return patterns;
+}
+
+// Classifies the first block of a file. Callers pass at most TEXT_SAMPLE_SIZE bytes.
+bool RegexAnalyzer::isTextFile(const char* sample, size_t size) {
+    if (size == 0) {
+        return true; // Empty file is technically text
+    }
+    
+    // Printable means isprint() in the C locale (0x20-0x7E) plus tab, newline and CR
+    size_t null_count = 0;
+    size_t printable_count = 0;
+    size_t i = 0;
+    
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i below_printable = _mm_set1_epi8(0x1F);
+    const __m128i delete_char = _mm_set1_epi8(0x7F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sample + i));
+        
+        // Bytes >= 0x80 are negative as signed chars, so the range test excludes them
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(block, below_printable),
+                                          _mm_cmplt_epi8(block, delete_char));
+        printable = _mm_or_si128(printable, _mm_cmpeq_epi8(block, tab));
+        printable = _mm_or_si128(printable, _mm_cmpeq_epi8(block, newline));
+        printable = _mm_or_si128(printable, _mm_cmpeq_epi8(block, carriage_return));
+        
+        null_count += __builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero))));
+        printable_count += __builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(printable)));
+    }
+#endif
+    
+    for (; i < size; ++i) {
+        unsigned char byte = static_cast<unsigned char>(sample[i]);
+        if (byte == 0) {
+            null_count++;
+        } else if ((byte >= 0x20 && byte < 0x7F) || byte == '\t' || byte == '\n' || byte == '\r') {
+            printable_count++;
+        }
+    }
+    
+    // Heuristic: if more than 5% null bytes, likely binary
+    if (null_count > size * 0.05) {
+        return false;
+    }
+    
+    // Heuristic: if less than 70% printable characters, likely binary
+    double printable_ratio = static_cast<double>(printable_count) / size;
+    if (printable_ratio < 0.70) {
+        return false;
+    }
+    
+    return true; // Passed all heuristics
+}
+
+bool RegexAnalyzer::detectText(const char* sample, size_t size) {
+    StageTimer timer(detect_ns);
+    return isTextFile(sample, size);
+}
+
+// Finds the expressions worth running std::regex for in [begin, end): the literal
+// prefilter drops expressions whose required literals are absent, then the
+// automaton drops those that cannot match. For the expressions it does match, the
+// reversed automaton reads back from the last match end to base and marks them in
+// context.located, with every position from base on where one of their matches
+// starts in context.located_starts. Unless split is null, context.live also marks the
+// covered expressions with an attempt from before split still running at end,
+// whichever engine is selected, since neither gate sees a match that ends past end.
+void RegexAnalyzer::findCandidates(const char* begin, const char* base, const char* split, const char* end,
+                                   ScanContext& context) {
+    auto& hits = context.hits;
+    auto& automaton_hits = context.automaton_hits;
+    hits.assign(expressions.size(), 0);
+    prefilter.scan(begin, end, hits);
+    context.live.assign(expressions.size(), 0);
+    context.located.assign(expressions.size(), 0);
+    
+    bool gate = (match_engine == MatchEngine::AUTOMATON);
+    bool need_automaton = (split != nullptr);
+    automaton_hits.resize(expressions.size());
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        // Expressions already ruled out count as found so the scan can stop early
+        automaton_hits[i] = !(gate && hits[i] && automaton.covers(i));
+        need_automaton = need_automaton || !automaton_hits[i];
+    }
+    if (!need_automaton) {
+        return;
+    }
+    context.scanner.scan(begin, end, automaton_hits, split, split ? &context.live : nullptr,
+                         gate ? &context.match_ends : nullptr);
+    if (!gate) {
+        return;
+    }
+    
+    size_t reach = static_cast<size_t>(base - begin);
+    bool any_located = false;
+    context.located_starts.resize(expressions.size());
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        if (!automaton.covers(i)) {
+            continue;
+        }
+        hits[i] = hits[i] && automaton_hits[i];
+        // The linear matcher already finds matches in one pass for expressions it has taken over
+        if (hits[i] && !context.regex_abandoned[i]) {
+            context.located[i] = 1;
+            context.located_starts[i].clear();
+            reach = std::max(reach, context.match_ends[i]);
+            any_located = true;
+        }
+    }
+    if (any_located) {
+        const char* reach_end = begin + reach;
+        context.reverse_scanner.scanBackward(base, reach_end, 
+                                             reach_end < end && isWordByte(static_cast<unsigned char>(*reach_end)),
+                                             base > begin && isWordByte(static_cast<unsigned char>(base[-1])),
+                                             context.located, context.located_starts);
+    }
+}
+
+// Confirms a live expression with the linear matcher, which knows where attempts started
+// and which of them a finished match outranks. Returns the leftmost start in
+// [start, owned_end) of a match that may still continue past limit, or SIZE_MAX.
+size_t RegexAnalyzer::liveStart(ScanContext& context, size_t expr_idx, const char* data, size_t data_offset,
+                                size_t start, size_t owned_end, size_t limit) {
+    auto at = [&](size_t offset) { return data + (offset - data_offset); };
+    size_t from = start;
+    while (from < owned_end) {
+        const char* match_begin;
+        const char* match_end;
+        const char* live;
+        bool found = context.linear_matcher.findOpen(expr_idx, at(from), at(owned_end), at(limit), 
+                                                     from > data_offset, match_begin, match_end, live);
+        if (live) {
+            return data_offset + static_cast<size_t>(live - data);
+        }
+        if (!found) {
+            break;
+        }
+        from = (match_end > match_begin) ? data_offset + static_cast<size_t>(match_end - data)
+                                         : data_offset + static_cast<size_t>(match_end - data) + 1;
+    }
+    return SIZE_MAX;
+}
+
+// Scans one window: expressions search [max(base, resume), limit) and report only matches
+// starting before owned_end, so nothing is reported twice. A match that reaches limit may
+// continue past it, as may one the automaton still has running at limit; unless final,
+// either is deferred to a window starting at that match with twice the look-ahead. Once
+// the look-ahead is at MAX_LOOKAHEAD such a match is recorded as a diagnostic instead, and
+// the expression moves on past it. data_end is the end of the data available.
+void RegexAnalyzer::scanWindow(const char* data, size_t data_offset, size_t owned_end, size_t limit,
+                               size_t data_end, bool final, WindowCursor& cursor, const std::string& filepath,
+                               ScanContext& context) {
+    const size_t base = cursor.base;
+    const bool capped = !final && cursor.lookahead >= MAX_LOOKAHEAD;
+    auto at = [&](size_t offset) { return data + (offset - data_offset); };
+    
+    // Statements may start up to OVERLAP_SIZE bytes before the window, and candidate
+    // detection includes the byte before base so word boundaries at base are judged right
+    size_t context_begin = std::max(data_offset, base > OVERLAP_SIZE ? base - OVERLAP_SIZE : 0);
+    size_t candidate_begin = std::max(data_offset, base > 0 ? base - 1 : 0);
+    findCandidates(at(candidate_begin), at(base), final ? nullptr : at(owned_end), at(limit), context);
+    
+    size_t next_base = owned_end;
+    bool line_index_built = false;
+    size_t base_line = 0;
+    
+    for (size_t expr_idx = 0; expr_idx < expressions.size(); ++expr_idx) {
+        const auto& expr = expressions[expr_idx];
+        size_t& resume = cursor.resume[expr_idx];
+        
+        if (expr.name.empty()) {
+            continue;
+        }
+        
+        size_t start = std::max(base, resume);
+        if (start >= owned_end) {
+            continue;
+        }
+        
+        // A match from the owned region that neither gate saw because it ends past limit
+        size_t live_start = context.live[expr_idx] 
+            ? liveStart(context, expr_idx, data, data_offset, start, owned_end, limit) : SIZE_MAX;
+        if (!context.hits[expr_idx] && live_start == SIZE_MAX) {
+            resume = owned_end;
+            continue;
+        }
+        
+        size_t last_end = start;
+        bool deferred = false;
+        bool stopped = false;            // The rest of the search belongs to a later window
+        bool last_empty = false;
+        size_t findings_before = context.findings.size();
+        auto search_start = std::chrono::steady_clock::now();
+        
+        // Hands the search from match_start on to a wider window, or gives up on that match
+        auto defer = [&](size_t match_start) {
+            deferred = true;
+            if (!capped) {
+                resume = match_start;
+                next_base = std::min(next_base, match_start);
+                return;
+            }
+            
+            ScanDiagnostic diagnostic;
+            diagnostic.kind = ScanDiagnostic::Kind::MATCH_TOO_LONG;
+            diagnostic.expression_id = static_cast<uint32_t>(expr_idx);
+            diagnostic.file = filepath;
+            diagnostic.offset = match_start;
+            diagnostic.reason = "match runs past the " + std::to_string(MAX_LOOKAHEAD) + "-byte look-ahead";
+            context.diagnostics.push_back(std::move(diagnostic));
+            context.incomplete = true;
+            
+            // Resuming inside the match would report its tail as a match of its own
+            resume = limit;
+            if (automaton.covers(expr_idx) && context.live[expr_idx]) {
+                resume = data_offset + static_cast<size_t>(context.scanner.liveUntil(expr_idx, at(limit), at(data_end)) - data);
+            }
+        };
+        
+        auto report = [&](size_t match_start, size_t match_end) {
+            if (match_start >= owned_end) {
+                return false; // Belongs to the next window
+            }
+            if (!final && (match_end >= limit || match_start >= live_start)) {
+                // May extend past the data scanned so far, or an earlier attempt may
+                // yet match there; rescan from whichever starts first
+                defer(std::min(match_start, live_start));
+                return false;
+            }
+            
+            // The newline index is only worth building once a window has a match
+            if (!line_index_built) {
+                context.line_index.build(at(context_begin), at(limit));
+                base_line = context.line_index.newlinesBefore(base - context_begin);
+                line_index_built = true;
+            }
+            const LineIndex& lines = context.line_index;
+            
+            size_t match_line = cursor.line_number + lines.newlinesBefore(match_start - context_begin) - base_line;
+            size_t line_start = context_begin + lines.lineStart(match_start - context_begin);
+            size_t line_end = context_begin + lines.lineEnd(match_end - context_begin);
+            
+            Finding finding;
+            finding.expression_id = static_cast<uint32_t>(expr_idx);
+            finding.line_number = static_cast<uint32_t>(match_line);
+            finding.statement_offset = storeStatement(context, filepath, at(line_start), line_start, line_end);
+            finding.file_id = context.file_id;
+            finding.statement_length = static_cast<uint32_t>(line_end - line_start);
+            finding.match_offset = static_cast<uint32_t>(match_start - line_start);
+            finding.match_length = static_cast<uint32_t>(match_end - match_start);
+            
+            context.findings.push_back(std::move(finding));
+            if (context.match_starts) {
+                context.match_starts->push_back(match_start);
+            }
+            last_end = match_end;
+            last_empty = (match_end == match_start);
+            return true;
+        };
+        
+        if (!context.hits[expr_idx]) {
+            stopped = true;
+        } else if (!context.regex_abandoned[expr_idx]) {
+            try {
+                auto flags = (start > data_offset) ? std::regex_constants::match_prev_avail 
+                                                   : std::regex_constants::match_default;
+                auto remaining = regex_budget - std::chrono::nanoseconds(context.regex_ns[expr_idx]);
+                RegexBudget budget(std::max(MIN_REGEX_STEPS, REGEX_STEPS_PER_BYTE * (limit - start)),
+                                   search_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(remaining));
+                
+                if (context.located[expr_idx]) {
+                    // std::regex runs only where the automaton found a match starting, anchored
+                    // there, visiting the matches in the order the iterator below would
+                    const auto& starts = context.located_starts[expr_idx];
+                    size_t next_start = starts.size();   // Starts run backwards: the next is starts[next_start - 1]
+                    size_t from = start;
+                    bool after_empty = false;
+                    std::match_results<BudgetIterator> match;
+                    while (true) {
+                        while (next_start > 0 && base + starts[next_start - 1] < from) {
+                            next_start--;
+                        }
+                        if (next_start == 0) {
+                            break;
+                        }
+                        size_t match_start = base + starts[next_start - 1];
+                        if (match_start >= owned_end) {
+                            stopped = true; // Belongs to the next window
+                            break;
+                        }
+                        
+                        // Where an empty match ended, the iterator first retries for a non-empty one
+                        bool retry = after_empty && match_start == from;
+                        std::regex_constants::match_flag_type attempt = std::regex_constants::match_continuous;
+                        if (match_start > data_offset) attempt |= std::regex_constants::match_prev_avail;
+                        if (retry) attempt |= std::regex_constants::match_not_null;
+                        if (!std::regex_search(BudgetIterator(at(match_start), &budget), BudgetIterator(at(limit), &budget),
+                                               match, expr.regex(), attempt)) {
+                            if (retry) {
+                                from = match_start + 1;
+                                after_empty = false;
+                            } else {
+                                next_start--;
+                            }
+                            continue;
+                        }
+                        
+                        size_t match_end = data_offset + static_cast<size_t>(match[0].second.base() - data);
+                        if (!report(match_start, match_end)) {
+                            stopped = true;
+                            break;
+                        }
+                        after_empty = (match_end == match_start);
+                        if (after_empty && match_end == limit) {
+                            break;
+                        }
+                        from = match_end;
+                    }
+                } else {
+                    std::regex_iterator<BudgetIterator> regex_start(BudgetIterator(at(start), &budget), 
+                                                                    BudgetIterator(at(limit), &budget), 
+                                                                    expr.regex(), flags);
+                    std::regex_iterator<BudgetIterator> regex_end;
+                    
+                    for (auto it = regex_start; it != regex_end; ++it) {
+                        const auto& match = (*it)[0];
+                        size_t match_start = data_offset + static_cast<size_t>(match.first.base() - data);
+                        size_t match_end = data_offset + static_cast<size_t>(match.second.base() - data);
+                        if (!report(match_start, match_end)) {
+                            stopped = true;
+                            break;
+                        }
+                    }
+                }
+                
+            } catch (const std::exception& e) {
+                // Matches reported so far stand; the rest of the file is left to the linear matcher
+                abandonSearch(context, expr_idx, filepath, last_end, e.what());
+            }
+            context.regex_ns[expr_idx] += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - search_start).count());
+        }
+        
+        if (context.regex_abandoned[expr_idx] && !stopped && automaton.covers(expr_idx)) {
+            size_t from = last_end + (last_empty ? 1 : 0);
+            const char* match_begin;
+            const char* match_end;
+            while (from <= limit && 
+                   context.linear_matcher.find(expr_idx, at(from), at(limit), from > data_offset, match_begin, match_end)) {
+                size_t match_start = data_offset + static_cast<size_t>(match_begin - data);
+                size_t match_stop = data_offset + static_cast<size_t>(match_end - data);
+                if (!report(match_start, match_stop)) {
+                    break;
+                }
+                from = (match_stop > match_start) ? match_stop : match_stop + 1;
+            }
+        }
+        
+        if (profiling && context.hits[expr_idx]) {
+            uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - search_start).count());
+            ExpressionCost& cost = context.costs[expr_idx];
+            cost.regex_ns += elapsed;
+            cost.bytes += limit - start;
+            cost.searches++;
+            cost.matches += context.findings.size() - findings_before;
+            if (elapsed > cost.worst_ns) {
+                cost.worst_ns = elapsed;
+                cost.worst_file = filepath;
+                cost.worst_offset = start;
+            }
+        }
+        
+        if (!deferred && live_start != SIZE_MAX) {
+            defer(live_start);
+        }
+        if (!deferred) {
+            resume = std::max(owned_end, last_end);
+        }
+    }
+    
+    if (next_base > base) {
+        cursor.line_number += static_cast<size_t>(std::count(at(base), at(next_base), '\n'));
+        cursor.base = next_base;
+    }
+}
+
+// Gives up on std::regex for an expression in the current file after a search ran over
+// its budget or failed. The rest of the file is searched by the linear matcher when the
+// automaton covers the expression and skipped otherwise; either way it is recorded.
+void RegexAnalyzer::abandonSearch(ScanContext& context, size_t expr_idx, const std::string& filepath,
+                                  size_t offset, const std::string& reason) {
+    context.regex_abandoned[expr_idx] = 1;
+    
+    ScanDiagnostic diagnostic;
+    diagnostic.kind = automaton.covers(expr_idx) ? ScanDiagnostic::Kind::LINEAR_FALLBACK 
+                                                 : ScanDiagnostic::Kind::SKIPPED;
+    diagnostic.expression_id = static_cast<uint32_t>(expr_idx);
+    diagnostic.file = filepath;
+    diagnostic.offset = offset;
+    diagnostic.reason = reason;
+    if (diagnostic.kind == ScanDiagnostic::Kind::SKIPPED) {
+        context.incomplete = true;
+    }
+    context.diagnostics.push_back(std::move(diagnostic));
+}
+
+void RegexAnalyzer::reportDiagnostics() const {
+    if (diagnostics.empty()) {
+        return;
+    }
+    
+    auto count = [this](ScanDiagnostic::Kind kind) {
+        return static_cast<size_t>(std::count_if(diagnostics.begin(), diagnostics.end(), 
+            [kind](const ScanDiagnostic& d) { return d.kind == kind; }));
+    };
+    size_t skipped = count(ScanDiagnostic::Kind::SKIPPED);
+    size_t too_long = count(ScanDiagnostic::Kind::MATCH_TOO_LONG);
+    size_t abandoned = diagnostics.size() - too_long;
+    if (abandoned > 0) {
+        std::cerr << "Warning: std::regex was abandoned for " << abandoned << " (file, expression) pairs: "
+                  << abandoned - skipped << " finished with the linear matcher, " 
+                  << skipped << " left unscanned" << std::endl;
+    }
+    if (too_long > 0) {
+        std::cerr << "Warning: " << too_long << " matches ran past the " << MAX_LOOKAHEAD 
+                  << "-byte look-ahead and were not reported" << std::endl;
+    }
+    
+    const size_t MAX_LISTED = 20;
+    for (size_t i = 0; i < diagnostics.size() && i < MAX_LISTED; ++i) {
+        const ScanDiagnostic& d = diagnostics[i];
+        std::cerr << "  " << expressions[d.expression_id].name << " in " << d.file << " from byte " << d.offset 
+                  << ": " << d.reason 
+                  << (d.kind == ScanDiagnostic::Kind::SKIPPED ? " (rest of file not scanned)" : "")
+                  << (d.kind == ScanDiagnostic::Kind::MATCH_TOO_LONG ? " (not reported)" : "") << std::endl;
+    }
+    if (diagnostics.size() > MAX_LISTED) {
+        std::cerr << "  ... and " << diagnostics.size() - MAX_LISTED << " more" << std::endl;
+    }
 }
 
-bool RegexAnalyzer::isTextFile(const std::string& filepath) {
-    try {
-        std::ifstream file(filepath, std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Warning: Cannot open file for text check: " << filepath << std::endl;
-            return false;
-        }
-        
-        // Read first chunk of file to analyze
-        const size_t sample_size = 8192; // 8KB sample
-        char buffer[8192];
+// Runs every window whose data is available in [data, data + size), which holds the file
+// bytes starting at data_offset. Returns the file offset before which bytes are no longer
+// needed; at_eof means the data runs to the end of the file. Windows own no bytes at or
+// past owned_limit, though matches starting before it may run on into those bytes.
+size_t RegexAnalyzer::scanWindows(const char* data, size_t size, size_t data_offset, bool at_eof,
+                                  WindowCursor& cursor, const std::string& filepath,
+                                  ScanContext& context, size_t owned_limit) {
+    const size_t data_end = data_offset + size;
+    
+    while (cursor.base < std::min(data_end, owned_limit)) {
+        size_t owned_end = std::min(cursor.base + WINDOW_SIZE, owned_limit);
+        size_t limit = owned_end + cursor.lookahead;
+        bool final = false;
         
-        // Initialize buffer to prevent reading garbage
-        memset(buffer, 0, sizeof(buffer));
+        if (limit >= data_end) {
+            if (!at_eof) {
+                break; // Wait for more data
+            }
+            limit = data_end;
+            owned_end = std::min(owned_end, data_end);
+            final = true;
+        }
         
-        file.read(buffer, sample_size);
-        std::streamsize bytes_read = file.gcount();
+        size_t base = cursor.base;
+        scanWindow(data, data_offset, owned_end, limit, data_end, final, cursor, filepath, context);
         
-        if (bytes_read <= 0) {
-            return true; // Empty file is technically text
+        // No progress means a match starting at base reached the window end: look further
+        cursor.lookahead = (cursor.base == base) ? cursor.lookahead * 2 : OVERLAP_SIZE;
+    }
+    
+    size_t keep_from = (cursor.base > OVERLAP_SIZE) ? cursor.base - OVERLAP_SIZE : 0;
+    return std::max(keep_from, data_offset);
+}
+
+// Stores the statement [line_start, line_end) of the current file, once per line, and
+// returns its offset in the file's line store. The file is interned on its first finding.
+uint64_t RegexAnalyzer::storeStatement(ScanContext& context, const std::string& filepath, 
+                                       const char* text, size_t line_start, size_t line_end) {
+    if (!context.file) {
+        std::lock_guard<std::mutex> lock(file_records_mutex);
+        context.file_id = static_cast<uint32_t>(file_records.size());
+        file_records.push_back(FileRecord{filepath, std::string(), context.target});
+        context.file = &file_records.back();
+    }
+    
+    auto stored = context.stored_lines.find(line_start);
+    if (stored != context.stored_lines.end() && stored->second.first == line_end) {
+        return stored->second.second; // Another expression already matched this line
+    }
+    
+    uint64_t offset = context.file->lines.size();
+    context.file->lines.append(text, line_end - line_start);
+    context.stored_lines[line_start] = {line_end, offset};
+    return offset;
+}
+
+FindingRecord RegexAnalyzer::outputRecord(const Finding& finding, const FileRecord& file) const {
+    FindingRecord record;
+    record.expression_id = finding.expression_id;
+    record.expression = expressions[finding.expression_id].name;
+    record.file = file.path;
+    record.line_number = finding.line_number;
+    record.statement = std::string_view(file.lines.data() + finding.statement_offset, finding.statement_length);
+    record.match_offset = finding.match_offset;
+    record.match_length = finding.match_length;
+    return record;
+}
+
+// Scans one file, classifying its first block as text or binary on the way in so
+// the file is opened and read only once
+RegexAnalyzer::FileScanResult RegexAnalyzer::scanFile(const std::string& filepath, ScanContext& context,
+                                                      const std::vector<char>* preloaded) {
+    bool is_text = false;
+    bool failed = false;
+    context.file = nullptr;
+    context.stored_lines.clear();
+    context.regex_ns.assign(expressions.size(), 0);
+    context.regex_abandoned = linear_only;
+    context.incomplete = false;
+    context.split.reset();
+    
+    // Per-file logging is opt-in; on large trees the console would become the bottleneck
+    auto announce = [this, &filepath] {
+        if (!verbose) {
+            return;
         }
+        static std::mutex debug_mutex;
+        std::lock_guard<std::mutex> lock(debug_mutex);
+        std::cout << "Processing: " << filepath << std::endl;
+    };
+    
+    try {
+        WindowCursor cursor;
+        cursor.lookahead = OVERLAP_SIZE;
+        cursor.resume.assign(expressions.size(), 0);
         
-        // Ensure we don't read beyond what was actually read
-        if (bytes_read > static_cast<std::streamsize>(sample_size)) {
-            bytes_read = static_cast<std::streamsize>(sample_size);
+        std::shared_ptr<const MappedFile> mapped;
+        if (!preloaded) {
+            mapped = std::make_shared<const MappedFile>(filepath, true);
         }
-        
-        // Check for null bytes (common in binary files)
-        int null_count = 0;
-        int printable_count = 0;
-        int control_count = 0;
-        
-        // Only iterate over the actual bytes read with bounds check
-        for (std::streamsize i = 0; i < bytes_read && i < static_cast<std::streamsize>(sample_size); ++i) {
-            unsigned char byte = static_cast<unsigned char>(buffer[i]);
+        if (preloaded || mapped->isMapped()) {
+            const char* data = preloaded ? preloaded->data() : mapped->data();
+            size_t size = preloaded ? preloaded->size() : mapped->size();
+            if (!detectText(data, std::min(size, TEXT_SAMPLE_SIZE))) {
+                progress.increment();
+                return FileScanResult::BINARY;
+            }
+            is_text = true;
+            announce();
+            
+            // A huge file would leave the other workers idle; its chunks are queued instead
+            if (mapped && size >= CHUNK_THRESHOLD && worker_count > 1) {
+                context.split = splitFile(filepath, std::move(mapped), -1, size, context.target);
+                return FileScanResult::SPLIT;
+            }
+            
+            // Windows are scanned in place over the mapping or the read-ahead buffer
+            {
+                StageTimer timer(match_ns);
+                scanWindows(data, size, 0, true, cursor, filepath, context);
+            }
+            progress.addBytes(size);
+        } else {
+            // A huge file that was not mapped, having been written in the last
+            // MappedFile::SETTLE_SECONDS, is split all the same; its chunks pread their bytes
+            struct stat st;
+            if (worker_count > 1 && ::stat(filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+                static_cast<uint64_t>(st.st_size) >= CHUNK_THRESHOLD) {
+                int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0 && ::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= CHUNK_THRESHOLD) {
+                    std::vector<char> sample(TEXT_SAMPLE_SIZE);
+                    ssize_t got = ::pread(fd, sample.data(), sample.size(), 0);
+                    if (!detectText(sample.data(), got > 0 ? static_cast<size_t>(got) : 0)) {
+                        ::close(fd);
+                        progress.increment();
+                        return FileScanResult::BINARY;
+                    }
+                    announce();
+                    context.split = splitFile(filepath, nullptr, fd, static_cast<size_t>(st.st_size), context.target);
+                    return FileScanResult::SPLIT;
+                }
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+            
+            // Streamed path for the other files that are not mapped: pipes, special files,
+            // and smaller recently written files
+            std::ifstream file(filepath, std::ios::binary);
+            if (!file.is_open()) {
+                std::cerr << "Warning: Could not open file: " << filepath << std::endl;
+                progress.increment();
+                return FileScanResult::FAILED;
+            }
+            
+            std::vector<char> buffer;
+            buffer.reserve(READ_SIZE + WINDOW_SIZE + 2 * OVERLAP_SIZE);
+            size_t buffer_offset = 0; // File offset of buffer[0]
+            bool at_eof = false;
             
-            if (byte == 0) {
-                null_count++;
-            } else if (std::isprint(byte) || byte == '\t' || byte == '\n' || byte == '\r') {
-                printable_count++;
-            } else if (byte < 32 || byte == 127) {
-                control_count++;
+            while (!at_eof) {
+                size_t filled = buffer.size();
+                buffer.resize(filled + READ_SIZE);
+                file.read(buffer.data() + filled, READ_SIZE);
+                buffer.resize(filled + static_cast<size_t>(file.gcount()));
+                progress.addBytes(static_cast<uint64_t>(file.gcount()));
+                at_eof = !file;
+                
+                // The first read doubles as the text/binary sample
+                if (!is_text) {
+                    if (!detectText(buffer.data(), std::min(buffer.size(), TEXT_SAMPLE_SIZE))) {
+                        progress.increment();
+                        return FileScanResult::BINARY;
+                    }
+                    is_text = true;
+                    announce();
+                }
+                
+                size_t keep_from;
+                {
+                    StageTimer timer(match_ns);
+                    keep_from = scanWindows(buffer.data(), buffer.size(), buffer_offset, at_eof,
+                                            cursor, filepath, context);
+                }
+                
+                // Drop bytes that have slid out of the window before reading more
+                buffer.erase(buffer.begin(), buffer.begin() + (keep_from - buffer_offset));
+                buffer_offset = keep_from;
             }
         }
         
-        // Heuristic: if more than 5% null bytes, likely binary
-        if (bytes_read > 0 && null_count > bytes_read * 0.05) {
-            return false;
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error processing file " << filepath << ": " << e.what() << std::endl;
+        failed = true;
+    } catch (...) {
+        std::cerr << "Unknown fatal error processing file " << filepath << std::endl;
+        failed = true;
+    }
+    
+    progress.increment();
+    if (failed) {
+        return FileScanResult::FAILED;
+    }
+    return is_text ? FileScanResult::TEXT : FileScanResult::BINARY;
+}
+
+// Scans one file, or replays its cached results when it is unchanged since the cached
+// run. A SPLIT file has had its chunks queued and is completed by finishChunkedFile.
+RegexAnalyzer::FileScanResult RegexAnalyzer::processFile(const std::string& filepath, ScanContext& context,
+                                                         const std::vector<char>* preloaded) {
+    ScanCache::FileKey key;
+    bool cacheable = !cache_file.empty() && ScanCache::fileKey(filepath, key);
+    
+    if (cacheable) {
+        ScanCache::Entry entry;
+        if (cache.take(filepath, key, entry)) {
+            replayCachedFile(filepath, entry, context);
+            cached_file_count++;
+            progress.increment();
+            return entry.is_text ? FileScanResult::TEXT : FileScanResult::BINARY;
         }
-        
-        // Heuristic: if less than 70% printable characters, likely binary
-        if (bytes_read > 0) {
-            double printable_ratio = static_cast<double>(printable_count) / bytes_read;
-            if (printable_ratio < 0.70) {
-                return false;
+    }
+    
+    FileScanResult result = scanFile(filepath, context, preloaded);
+    
+    if (result == FileScanResult::SPLIT) {
+        // Chunks are queued only now, so the cache key is in place before any can finish
+        ChunkedFile& file = *context.split;
+        file.cacheable = cacheable;
+        file.key = key;
+        file.remaining = file.chunks.size();
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            for (size_t i = 0; i < file.chunks.size(); ++i) {
+                const ChunkedFile::Chunk& chunk = file.chunks[i];
+                file_queue.push_back(QueuedFile{filepath, file.target, context.split, i, chunk.end - chunk.begin});
+                std::push_heap(file_queue.begin(), file_queue.end());
             }
         }
-        
-        // Additional check for UTF-8 BOM - ensure we have enough bytes
-        if (bytes_read >= 3 && 
-            static_cast<unsigned char>(buffer[0]) == 0xEF &&
-            static_cast<unsigned char>(buffer[1]) == 0xBB &&
-            static_cast<unsigned char>(buffer[2]) == 0xBF) {
-            return true; // UTF-8 BOM indicates text file
+        queue_cv.notify_all();
+        context.split.reset();
+        return result;
+    }
+    
+    // Failed and incomplete scans are left out so the next run tries them again
+    if (cacheable && result != FileScanResult::FAILED && !context.incomplete) {
+        cache.record(filepath, key, result == FileScanResult::TEXT, 
+                     context.file ? static_cast<int64_t>(context.file_id) : -1);
+    }
+    return result;
+}
+
+void RegexAnalyzer::replayCachedFile(const std::string& filepath, ScanCache::Entry& entry, ScanContext& context) {
+    context.file = nullptr;
+    
+    if (!entry.findings.empty()) {
+        std::lock_guard<std::mutex> lock(file_records_mutex);
+        context.file_id = static_cast<uint32_t>(file_records.size());
+        file_records.push_back(FileRecord{filepath, std::move(entry.lines), context.target});
+        context.file = &file_records.back();
+    }
+    
+    for (Finding& finding : entry.findings) {
+        finding.file_id = context.file_id;
+        context.findings.push_back(std::move(finding));
+    }
+    
+    cache.record(filepath, entry.key, entry.is_text, 
+                 context.file ? static_cast<int64_t>(context.file_id) : -1);
+}
+
+// ChunkedFile implementation
+ChunkedFile::~ChunkedFile() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+size_t ChunkedFile::read(size_t offset, size_t count, char* out) const {
+    count = (offset < size) ? std::min(count, size - offset) : 0;
+    if (mapping) {
+        std::memcpy(out, mapping->data() + offset, count);
+        return count;
+    }
+    
+    size_t filled = 0;
+    while (filled < count) {
+        ssize_t got = ::pread(fd, out + filled, count - filled, static_cast<off_t>(offset + filled));
+        if (got < 0 && errno == EINTR) {
+            continue;
         }
-        
-        return true; // Passed all heuristics
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error checking if file is text: " << filepath << " - " << e.what() << std::endl;
-        return false;
-    } catch (...) {
-        std::cerr << "Unknown error checking if file is text: " << filepath << std::endl;
-        return false;
+        if (got <= 0) {
+            break;
+        }
+        filled += static_cast<size_t>(got);
     }
+    return filled;
 }
 
-void RegexAnalyzer::processFile(const std::string& filepath) {
+// Cuts a file into chunks of about CHUNK_SIZE that each end just after a newline.
+// A stretch without newlines stays in one chunk.
+std::shared_ptr<ChunkedFile> RegexAnalyzer::splitFile(const std::string& filepath, 
+                                                      std::shared_ptr<const MappedFile> mapping,
+                                                      int fd, size_t size, uint32_t target) {
+    auto file = std::make_shared<ChunkedFile>();
+    file->path = filepath;
+    file->target = target;
+    file->mapping = std::move(mapping);
+    file->fd = fd;
+    file->size = size;
+    
+    // First newline in [from, from + CHUNK_SIZE), or SIZE_MAX
+    std::vector<char> block(file->mapping ? 0 : READ_SIZE);
+    auto find_newline = [&](size_t from) -> size_t {
+        const size_t to = std::min(from + CHUNK_SIZE, size);
+        if (file->mapping) {
+            const char* data = file->mapping->data();
+            const void* newline = std::memchr(data + from, '\n', to - from);
+            return newline ? static_cast<size_t>(static_cast<const char*>(newline) - data) : SIZE_MAX;
+        }
+        for (size_t offset = from; offset < to; offset += block.size()) {
+            size_t got = file->read(offset, std::min(block.size(), to - offset), block.data());
+            const void* newline = std::memchr(block.data(), '\n', got);
+            if (newline) {
+                return offset + static_cast<size_t>(static_cast<const char*>(newline) - block.data());
+            }
+            if (got < std::min(block.size(), to - offset)) {
+                break; // Shrank since it was opened
+            }
+        }
+        return SIZE_MAX;
+    };
+    
+    size_t begin = 0;
+    while (begin < size) {
+        size_t end = size;
+        for (size_t probe = begin + CHUNK_SIZE; probe < size; probe += CHUNK_SIZE) {
+            size_t newline = find_newline(probe);
+            if (newline != SIZE_MAX) {
+                end = newline + 1;
+                break;
+            }
+        }
+        file->chunks.emplace_back();
+        file->chunks.back().begin = begin;
+        file->chunks.back().end = end;
+        begin = end;
+    }
+    return file;
+}
+
+// Scans one chunk's owned bytes, each expression from its resume offset, and appends the
+// findings to the chunk. Matches that start in the chunk may run on into the next one,
+// exactly as across windows. Returns where each expression's search ended.
+std::vector<size_t> RegexAnalyzer::scanChunk(ChunkedFile& file, size_t index, std::vector<size_t> resume, 
+                                             ScanContext& context) {
+    ChunkedFile::Chunk& chunk = file.chunks[index];
+    
+    context.file = &chunk.record;
+    context.file_id = 0;
+    context.stored_lines.clear();
+    context.regex_ns.assign(expressions.size(), 0);
+    context.regex_abandoned = linear_only;
+    context.incomplete = false;
+    context.match_starts = &chunk.match_starts;
+    size_t first = context.findings.size();
+    
+    WindowCursor cursor;
+    cursor.base = chunk.begin;
+    cursor.lookahead = OVERLAP_SIZE;
+    cursor.resume = std::move(resume);
     try {
-        std::ifstream file(filepath);
-        if (!file.is_open()) {
-            std::cerr << "Warning: Could not open file: " << filepath << std::endl;
-            progress.increment();
-            return;
+        StageTimer timer(match_ns);
+        if (file.mapping) {
+            scanWindows(file.mapping->data(), file.mapping->size(), 0, true, cursor, file.path, context, chunk.end);
+        } else {
+            // Streamed like an unmapped file, from the newline before the chunk so the
+            // windows see the byte before it as they would in a mapping
+            std::vector<char> buffer;
+            buffer.reserve(READ_SIZE + WINDOW_SIZE + 2 * OVERLAP_SIZE);
+            size_t buffer_offset = (chunk.begin > 0) ? chunk.begin - 1 : 0;
+            bool at_eof = false;
+            while (!at_eof && cursor.base < chunk.end) {
+                size_t filled = buffer.size();
+                buffer.resize(filled + READ_SIZE);
+                size_t got = file.read(buffer_offset + filled, READ_SIZE, buffer.data() + filled);
+                buffer.resize(filled + got);
+                at_eof = (got < READ_SIZE);
+                
+                size_t keep_from = scanWindows(buffer.data(), buffer.size(), buffer_offset, at_eof,
+                                               cursor, file.path, context, chunk.end);
+                buffer.erase(buffer.begin(), buffer.begin() + (keep_from - buffer_offset));
+                buffer_offset = keep_from;
+            }
+        }
+        chunk.newlines = cursor.line_number - 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error processing file " << file.path << " at byte " << chunk.begin << ": " << e.what() << std::endl;
+        chunk.newlines = 0;
+        char block[16 * 1024];
+        for (size_t offset = chunk.begin; offset < chunk.end; offset += sizeof(block)) {
+            size_t got = file.read(offset, std::min(sizeof(block), chunk.end - offset), block);
+            chunk.newlines += static_cast<size_t>(std::count(block, block + got, '\n'));
+            if (got < std::min(sizeof(block), chunk.end - offset)) {
+                break;
+            }
+        }
+        chunk.match_starts.resize(chunk.findings.size());
+        context.findings.truncate(first);
+        cursor.resume.assign(expressions.size(), chunk.end);
+        context.incomplete = true;
+    }
+    chunk.incomplete = chunk.incomplete || context.incomplete;
+    
+    size_t last = context.findings.size();
+    for (size_t i = first; i < last; ++i) {
+        chunk.findings.push_back(context.findings[i]);
+    }
+    context.findings.truncate(first);
+    context.match_starts = nullptr;
+    context.file = nullptr;
+    return std::move(cursor.resume);
+}
+
+// Joins the chunks of a split file in file order: statement stores are concatenated, line
+// numbers made absolute, and the file is interned and recorded like any scanned file.
+void RegexAnalyzer::finishChunkedFile(ChunkedFile& file, ScanContext& context) {
+    const size_t expression_count = expressions.size();
+    
+    // A match from an earlier chunk ran into this one; matches of that expression that
+    // overlap it are not real, so search the chunk again from where that match ended
+    std::vector<size_t> reach(expression_count, 0);
+    for (size_t index = 0; index < file.chunks.size(); ++index) {
+        ChunkedFile::Chunk& chunk = file.chunks[index];
+        std::vector<char> overlapped(expression_count, 0);
+        bool rescan = false;
+        for (size_t i = 0; i < chunk.findings.size(); ++i) {
+            uint32_t expr_idx = chunk.findings[i].expression_id;
+            if (chunk.match_starts[i] < reach[expr_idx]) {
+                overlapped[expr_idx] = 1;
+                rescan = true;
+            }
         }
         
-        std::vector<Finding> local_findings;
-        local_findings.reserve(100);
-        
-        const size_t BUFFER_SIZE = 64 * 1024; // 64KB buffer
-        const size_t WINDOW_SIZE = 32 * 1024; // 32KB sliding window for regex processing
-        const size_t OVERLAP_SIZE = 16 * 1024; // 16KB overlap to catch patterns across boundaries
+        if (rescan) {
+            size_t kept = 0;
+            for (size_t i = 0; i < chunk.findings.size(); ++i) {
+                if (!overlapped[chunk.findings[i].expression_id]) {
+                    chunk.findings[kept] = chunk.findings[i];
+                    chunk.match_starts[kept] = chunk.match_starts[i];
+                    kept++;
+                }
+            }
+            chunk.findings.resize(kept);
+            chunk.match_starts.resize(kept);
+            
+            std::vector<size_t> resume(expression_count, chunk.end);
+            for (size_t e = 0; e < expression_count; ++e) {
+                if (overlapped[e]) resume[e] = reach[e];
+            }
+            std::vector<size_t> rescanned = scanChunk(file, index, std::move(resume), context);
+            for (size_t e = 0; e < expression_count; ++e) {
+                if (overlapped[e]) chunk.reach[e] = rescanned[e];
+            }
+        }
         
-        char buffer[BUFFER_SIZE];
-        std::string window;
-        window.reserve(WINDOW_SIZE + OVERLAP_SIZE);
-        int line_number = 1;
-        size_t file_position = 0;
+        for (size_t e = 0; e < expression_count; ++e) {
+            reach[e] = std::max(reach[e], chunk.reach[e]);
+        }
+    }
+    
+    context.file = nullptr;
+    size_t finding_total = 0;
+    size_t lines_total = 0;
+    for (const auto& chunk : file.chunks) {
+        finding_total += chunk.findings.size();
+        lines_total += chunk.record.lines.size();
+    }
+    
+    if (finding_total > 0) {
+        std::lock_guard<std::mutex> lock(file_records_mutex);
+        context.file_id = static_cast<uint32_t>(file_records.size());
+        file_records.push_back(FileRecord{file.path, std::string(), file.target});
+        context.file = &file_records.back();
+        context.file->lines.reserve(lines_total);
+    }
+    
+    size_t line_base = 0;
+    for (auto& chunk : file.chunks) {
+        uint64_t store_base = context.file ? context.file->lines.size() : 0;
+        for (Finding finding : chunk.findings) {
+            finding.file_id = context.file_id;
+            finding.line_number += static_cast<uint32_t>(line_base);
+            finding.statement_offset += store_base;
+            context.findings.push_back(std::move(finding));
+        }
+        if (context.file) {
+            context.file->lines += chunk.record.lines;
+        }
+        line_base += chunk.newlines;
         
-        while (file.read(buffer, BUFFER_SIZE) || file.gcount() > 0) {
-            std::streamsize bytes_read = file.gcount();
+        std::vector<Finding>().swap(chunk.findings);
+        std::string().swap(chunk.record.lines);
+    }
+    file.mapping.reset();
+    if (file.fd >= 0) {
+        ::close(file.fd);
+        file.fd = -1;
+    }
+    
+    bool incomplete = std::any_of(file.chunks.begin(), file.chunks.end(),
+                                  [](const ChunkedFile::Chunk& chunk) { return chunk.incomplete; });
+    if (file.cacheable && !incomplete) {
+        cache.record(file.path, file.key, true, context.file ? static_cast<int64_t>(context.file_id) : -1);
+    }
+    progress.increment();
+}
+
+// Identifies everything cached results depend on: the expressions and the window
+// geometry that bounds statements
+uint64_t RegexAnalyzer::expressionSetHash() const {
+    const uint64_t CACHE_FORMAT_VERSION = 3;   // 2: matches running past a window are no longer cut short
+                                               // 3: files with skipped or unreported matches are no longer cached
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    
+    const uint64_t geometry[] = {CACHE_FORMAT_VERSION, WINDOW_SIZE, OVERLAP_SIZE, MAX_LOOKAHEAD};
+    mix(geometry, sizeof(geometry));
+    for (const auto& expr : expressions) {
+        mix(expr.name.data(), expr.name.size() + 1);
+        mix(expr.source.data(), expr.source.size() + 1);
+        mix(&expr.icase, sizeof(expr.icase));
+    }
+    return hash;
+}
+
+// Walks every target's tree with parallel DirectoryWalker threads, handing each regular
+// file to the workers as soon as it is found. Text detection happens in processFile.
+// Targets whose directory is unusable are reported and skipped. Returns the number of
+// files discovered.
+size_t RegexAnalyzer::findTextFiles(int num_threads) {
+    std::atomic<size_t> discovered{0};
+    std::vector<std::string> roots;
+    std::vector<uint32_t> root_targets;
+    
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const std::string& directory = targets[t].directory;
+        try {
+            if (!std::filesystem::exists(directory)) {
+                std::cerr << "Error: Directory does not exist: " << directory << std::endl;
+                continue;
+            }
             
-            // Add new data to window
-            for (std::streamsize i = 0; i < bytes_read; ++i) {
-                window += buffer[i];
-                
-                // When window gets full, process it and slide
-                if (window.size() >= WINDOW_SIZE + OVERLAP_SIZE) {
-                    // Process the first WINDOW_SIZE bytes
-                    std::string segment = window.substr(0, WINDOW_SIZE);
-                    
-                    // Count line numbers in this segment
-                    int segment_line_start = line_number;
-                    for (size_t j = 0; j < segment.size(); ++j) {
-                        if (segment[j] == '\n') {
-                            line_number++;
-                        }
-                    }
-                    
-                    // Process this segment with all expressions
-                    for (size_t expr_idx = 0; expr_idx < expressions.size(); ++expr_idx) {
-                        try {
-                            const auto& expr = expressions[expr_idx];
-                            
-                            if (expr.name.empty()) {
-                                continue;
-                            }
-                            
-                            std::sregex_iterator regex_start(segment.begin(), segment.end(), expr.pattern);
-                            std::sregex_iterator regex_end;
-                            
-                            for (std::sregex_iterator it = regex_start; it != regex_end; ++it) {
-                                std::smatch match = *it;
-                                
-                                // Calculate approximate line number for this match
-                                std::string before_match = segment.substr(0, match.position());
-                                int match_line = segment_line_start;
-                                for (char c : before_match) {
-                                    if (c == '\n') match_line++;
-                                }
-                                
-                                // Extract the line containing the match
-                                size_t line_start = match.position();
-                                while (line_start > 0 && segment[line_start - 1] != '\n') {
-                                    line_start--;
-                                }
-                                
-                                size_t line_end = match.position() + match.length();
-                                while (line_end < segment.size() && segment[line_end] != '\n') {
-                                    line_end++;
-                                }
-                                
-                                std::string match_line_content = segment.substr(line_start, line_end - line_start);
-                                
-                                Finding finding;
-                                finding.expression_name = expr.name;
-                                finding.filename = filepath;
-                                finding.line_number = match_line;
-                                finding.actual_match = match.str();
-                                finding.statement = match_line_content;
-                                
-                                local_findings.push_back(std::move(finding));
-                            }
-                            
-                        } catch (const std::regex_error& e) {
-                            // Continue processing other expressions
-                            continue;
-                        } catch (const std::exception& e) {
-                            // Continue processing other expressions
-                            continue;
-                        }
-                    }
-                    
-                    // Slide the window - keep the overlap part
-                    window = window.substr(WINDOW_SIZE - OVERLAP_SIZE);
-                    file_position += WINDOW_SIZE - OVERLAP_SIZE;
-                }
+            if (!std::filesystem::is_directory(directory)) {
+                std::cerr << "Error: Path is not a directory: " << directory << std::endl;
+                continue;
             }
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Error accessing directory: " << e.what() << std::endl;
+            continue;
+        }
+        roots.push_back(directory);
+        root_targets.push_back(static_cast<uint32_t>(t));
+    }
+    if (roots.empty()) {
+        return 0;
+    }
+    
+    DirectoryWalker walker;
+    walker.walk(roots, num_threads, [this, &discovered, &root_targets](const std::string& filepath, uint32_t root,
+                                                                      uint64_t size) {
+        uint32_t target = root_targets[root];
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            file_queue.push_back(QueuedFile{filepath, target, nullptr, 0, size});
+            std::push_heap(file_queue.begin(), file_queue.end());
         }
+        progress.addTotal(1, size);
+        targets[target].discovered++;
+        discovered++;
+        queue_cv.notify_one();
+    });
+    
+    return discovered.load();
+}
+
+void RegexAnalyzer::workerThread(size_t shard_index) {
+    ScanContext context(automaton, reverse_automaton, all_findings.shard(shard_index));
+    if (profiling) {
+        context.costs.resize(expressions.size());
+    }
+    
+    while (true) {
+        LoadedFile loaded;
         
-        // Process any remaining data in the window
-        if (!window.empty()) {
-            // Count remaining line numbers
-            for (char c : window) {
-                if (c == '\n') {
-                    line_number++;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (read_ahead_depth > 0) {
+                ready_cv.wait(lock, [this] { return !ready_queue.empty() || feeding_done; });
+                if (ready_queue.empty()) {
+                    break;
                 }
-            }
-            
-            // Process remaining content with all expressions
-            for (size_t expr_idx = 0; expr_idx < expressions.size(); ++expr_idx) {
-                try {
-                    const auto& expr = expressions[expr_idx];
-                    
-                    if (expr.name.empty()) {
-                        continue;
-                    }
-                    
-                    std::sregex_iterator regex_start(window.begin(), window.end(), expr.pattern);
-                    std::sregex_iterator regex_end;
-                    
-                    for (std::sregex_iterator it = regex_start; it != regex_end; ++it) {
-                        std::smatch match = *it;
-                        
-                        // Calculate line number for this match
-                        std::string before_match = window.substr(0, match.position());
-                        int match_line = line_number - std::count(window.begin(), window.end(), '\n');
-                        for (char c : before_match) {
-                            if (c == '\n') match_line++;
-                        }
-                        
-                        // Extract the line containing the match
-                        size_t line_start = match.position();
-                        while (line_start > 0 && window[line_start - 1] != '\n') {
-                            line_start--;
-                        }
-                        
-                        size_t line_end = match.position() + match.length();
-                        while (line_end < window.size() && window[line_end] != '\n') {
-                            line_end++;
-                        }
-                        
-                        std::string match_line_content = window.substr(line_start, line_end - line_start);
-                        
-                        Finding finding;
-                        finding.expression_name = expr.name;
-                        finding.filename = filepath;
-                        finding.line_number = match_line;
-                        finding.actual_match = match.str();
-                        finding.statement = match_line_content;
-                        
-                        local_findings.push_back(std::move(finding));
-                    }
-                    
-                } catch (const std::regex_error& e) {
-                    continue;
-                } catch (const std::exception& e) {
-                    continue;
+                loaded = std::move(ready_queue.front());
+                ready_queue.pop_front();
+            } else {
+                // A busy worker may still split a file and queue its chunks
+                queue_cv.wait(lock, [this] { return !file_queue.empty() || (discovery_done && busy_workers == 0); });
+                if (file_queue.empty()) {
+                    break;
                 }
+                std::pop_heap(file_queue.begin(), file_queue.end());
+                loaded.item = std::move(file_queue.back());
+                file_queue.pop_back();
             }
+            busy_workers++;
         }
+        const QueuedFile& item = loaded.item;
+        context.target = item.target;
         
-        // Add findings
-        if (!local_findings.empty()) {
-            std::lock_guard<std::mutex> lock(findings_mutex);
-            all_findings.insert(all_findings.end(), 
-                               std::make_move_iterator(local_findings.begin()),
-                               std::make_move_iterator(local_findings.end()));
+        size_t first = context.findings.size();
+        bool text = false;
+        if (item.chunked) {
+            ChunkedFile::Chunk& chunk = item.chunked->chunks[item.chunk];
+            chunk.reach = scanChunk(*item.chunked, item.chunk, std::vector<size_t>(expressions.size(), chunk.begin), context);
+            progress.addBytes(chunk.end - chunk.begin);
+            progress.finishBytes(item.size);
+            if (--item.chunked->remaining == 0) {
+                finishChunkedFile(*item.chunked, context);
+                text = true;
+            }
+        } else {
+            // Binary files are detected and dropped inside processFile. A split file's
+            // bytes are finished by its chunks instead.
+            FileScanResult result = processFile(item.path, context, loaded.loaded ? &loaded.data : nullptr);
+            text = (result == FileScanResult::TEXT);
+            if (result != FileScanResult::SPLIT) {
+                progress.finishBytes(item.size);
+            }
+        }
+        if (text) {
+            text_file_count++;
+            targets[context.target].text_files++;
         }
+        emitFindings(context, first);
         
-    } catch (const std::exception& e) {
-        std::cerr << "Fatal error processing file " << filepath << ": " << e.what() << std::endl;
-    } catch (...) {
-        std::cerr << "Unknown fatal error processing file " << filepath << std::endl;
+        std::vector<char>().swap(loaded.data);
+        
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            busy_workers--;
+            read_ahead_bytes -= loaded.reserved;
+            if (loaded.reserved > 0 || (busy_workers == 0 && discovery_done && file_queue.empty())) {
+                queue_cv.notify_all();
+            }
+        }
+    }
+    
+    if (profiling) {
+        profile.merge(context.costs);
+    }
+    if (!context.diagnostics.empty()) {
+        std::lock_guard<std::mutex> lock(diagnostics_mutex);
+        diagnostics.insert(diagnostics.end(), std::make_move_iterator(context.diagnostics.begin()),
+                           std::make_move_iterator(context.diagnostics.end()));
+    }
+}
+
+// Takes files from the size-ordered queue and keeps reads in flight for them, so storage
+// latency overlaps matching. Chunks of split files, files too large to hold in memory and
+// files likely to be replayed from the scan cache go straight to the workers, which map
+// them as usual. Stops once nothing is queued, read, ready or able to add work.
+void RegexAnalyzer::feederThread(ReadAhead& reader) {
+    while (true) {
+        QueuedFile item;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] {
+                return (!file_queue.empty() && read_ahead_bytes < READ_AHEAD_LIMIT) ||
+                       (file_queue.empty() && discovery_done && busy_workers == 0 && 
+                        reads_in_flight == 0 && ready_queue.empty());
+            });
+            if (file_queue.empty()) {
+                break;
+            }
+            std::pop_heap(file_queue.begin(), file_queue.end());
+            item = std::move(file_queue.back());
+            file_queue.pop_back();
+            
+            bool direct = item.chunked || item.size >= CHUNK_THRESHOLD || 
+                          (!cache_file.empty() && cache.has(item.path));
+            if (direct) {
+                LoadedFile passed;
+                passed.item = std::move(item);
+                ready_queue.push_back(std::move(passed));
+                ready_cv.notify_one();
+                continue;
+            }
+            reads_in_flight++;
+            read_ahead_bytes += item.size;
+        }
+        
+        std::string path = item.path;
+        reader.submit(path, [this, item](std::vector<char>&& data, int error) {
+            LoadedFile loaded;
+            loaded.item = item;
+            loaded.data = std::move(data);
+            loaded.loaded = (error == 0);
+            loaded.reserved = item.size;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                ready_queue.push_back(std::move(loaded));
+                reads_in_flight--;
+            }
+            ready_cv.notify_one();
+        });
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        feeding_done = true;
+    }
+    ready_cv.notify_all();
+}
+
+void RegexAnalyzer::emitFindings(ScanContext& context, size_t first) {
+    size_t last = context.findings.size();
+    if (last == first) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        StageTimer timer(write_ns);
+        for (const auto& sink : targets[context.file->target].sinks) {
+            if (!sink->streaming()) {
+                continue;
+            }
+            for (size_t i = first; i < last; ++i) {
+                sink->write(outputRecord(context.findings[i], *context.file));
+            }
+        }
+    }
+    finding_count += last - first;
+    targets[context.file->target].findings += last - first;
+    
+    if (!retain_findings) {
+        context.findings.truncate(first);
+        std::string().swap(context.file->lines);
+    }
+}
+
+void RegexAnalyzer::openSinks() {
+    std::vector<std::string> formats = output_formats;
+    if (formats.empty()) {
+        formats.push_back(USE_XLSX ? "xlsx" : "xml");
+    }
+    
+    std::vector<std::string> expression_names;
+    for (const auto& expr : expressions) {
+        expression_names.push_back(expr.name);
+    }
+    
+    retain_findings = !cache_file.empty();
+    for (auto& target : targets) {
+        target.sinks.clear();
+        for (const std::string& format : formats) {
+            target.sinks.push_back(OutputSink::create(format, target.output_file));
+            target.sinks.back()->begin(expression_names);
+            retain_findings = retain_findings || !target.sinks.back()->streaming();
+        }
     }
-    
-    progress.increment();
 }
 
-std::vector<std::string> RegexAnalyzer::findTextFiles(const std::string& directory) {
-    std::vector<std::string> text_files;
+void RegexAnalyzer::writeResults() {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    StageTimer timer(write_ns);
     
-    try {
-        if (!std::filesystem::exists(directory)) {
-            std::cerr << "Error: Directory does not exist: " << directory << std::endl;
-            return text_files;
-        }
-        
-        if (!std::filesystem::is_directory(directory)) {
-            std::cerr << "Error: Path is not a directory: " << directory << std::endl;
-            return text_files;
-        }
-        
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
-            try {
-                if (entry.is_regular_file()) {
-                    if (isTextFile(entry.path().string())) {
-                        text_files.push_back(entry.path().string());
+    for (size_t t = 0; t < targets.size(); ++t) {
+        for (const auto& sink : targets[t].sinks) {
+            if (!sink->streaming()) {
+                for (const auto& finding : all_findings) {
+                    const FileRecord& file = file_records[finding.file_id];
+                    if (file.target == t) {
+                        sink->write(outputRecord(finding, file));
                     }
                 }
-            } catch (const std::filesystem::filesystem_error& e) {
-                std::cerr << "Error accessing file: " << entry.path() 
-                         << " - " << e.what() << std::endl;
-                continue; // Skip this file and continue
             }
+            sink->finish();
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Error accessing directory: " << e.what() << std::endl;
+        targets[t].sinks.clear();
     }
-    
-    return text_files;
 }
 
-void RegexAnalyzer::workerThread() {
-    while (true) {
-        std::string filepath;
-        
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            if (file_queue.empty()) {
-                break;
-            }
-            filepath = file_queue.back();
-            file_queue.pop_back();
-        }
-        
-        // Debug output to track which file is being processed
-        static std::mutex debug_mutex;
-        {
-            std::lock_guard<std::mutex> lock(debug_mutex);
-            std::cout << "Processing: " << filepath << std::endl;
-        }
-        
-        processFile(filepath);
-    }
+void RegexAnalyzer::setMatchEngine(MatchEngine engine) {
+    match_engine = engine;
 }
 
-void RegexAnalyzer::analyze(const std::string& directory, const std::string& expressions_file, 
-            const std::string& output_file, int num_threads) {
+void RegexAnalyzer::setCacheFile(const std::string& path) {
+    cache_file = path;
+}
+
+void RegexAnalyzer::setPatternCacheFile(const std::string& path) {
+    pattern_cache_file = path;
+}
+
+void RegexAnalyzer::setOutputFormats(const std::vector<std::string>& formats) {
+    output_formats = formats;
+}
+
+void RegexAnalyzer::setVerbose(bool enabled) {
+    verbose = enabled;
+}
+
+void RegexAnalyzer::setReadAhead(size_t depth) {
+    read_ahead_depth = depth;
+}
+
+void RegexAnalyzer::setRegexBudget(std::chrono::milliseconds budget) {
+    regex_budget = std::max(budget, std::chrono::milliseconds(1));
+}
+
+void RegexAnalyzer::setProfile(bool enabled, const std::string& json_path) {
+    profiling = enabled || !json_path.empty();
+    profile_file = json_path;
+}
+
+// Fills expressions, the prefilter and both automata: from the pattern cache when it was
+// written for this exact properties file, otherwise by loading and compiling (and then
+// refreshing the cache)
+void RegexAnalyzer::compileExpressions(const std::string& expressions_file) {
+    uint64_t properties_hash = 0;
+    bool cacheable = !pattern_cache_file.empty() && PatternCache::propertiesHash(expressions_file, properties_hash);
     
-    std::cout << "Loading expressions from: " << expressions_file << std::endl;
-    expressions = loadExpressions(expressions_file);
+    if (cacheable && PatternCache::load(pattern_cache_file, properties_hash, expressions, prefilter, 
+                                        automaton, reverse_automaton)) {
+        std::cout << "Loaded " << expressions.size() << " compiled expressions from " << pattern_cache_file << std::endl;
+        return;
+    }
     
+    expressions = loadExpressions(expressions_file);
     if (expressions.empty()) {
         throw std::runtime_error("No valid expressions found in properties file");
     }
-    
     std::cout << "Loaded " << expressions.size() << " expressions" << std::endl;
-    std::cout << "Scanning directory: " << directory << std::endl;
-    
-    file_queue = findTextFiles(directory);
-    std::cout << "Found " << file_queue.size() << " text files" << std::endl;
-    
-    if (file_queue.empty()) {
-        std::cout << "No text files found to process" << std::endl;
-        return;
-    }
-    
-    progress.setTotal(file_queue.size());
-    std::cout << "Starting analysis with " << num_threads << " threads..." << std::endl;
     
-    // Launch worker threads
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back(&RegexAnalyzer::workerThread, this);
-    }
+    prefilter.build(expressions);
+    // The automaton also backs the linear fallback, so it is built for either engine
+    automaton.compile(expressions, false, verbose);
+    reverse_automaton.compile(expressions, true);
     
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        thread.join();
+    if (cacheable) {
+        if (PatternCache::save(pattern_cache_file, properties_hash, expressions, prefilter, automaton, reverse_automaton)) {
+            std::cout << "Saved compiled expressions to " << pattern_cache_file << std::endl;
+        } else {
+            std::cerr << "Warning: Could not write pattern cache: " << pattern_cache_file << std::endl;
+        }
     }
-    
-    std::cout << std::endl << "Analysis complete. Found " << all_findings.size() << " matches" << std::endl;
-    std::cout << "Writing results to: " << output_file << std::endl;
-    
-    writeResults(output_file);
 }
 
-void RegexAnalyzer::writeResults(const std::string& output_filename) {
-#if USE_XLSX
-    writeXLSXResults(output_filename);
-#else
-    writeXMLSpreadsheetResults(output_filename);
-#endif
+void RegexAnalyzer::analyze(const std::string& directory, const std::string& expressions_file, 
+            const std::string& output_file, int num_threads) {
+    targets.clear();
+    targets.emplace_back(directory, output_file);
+    run(expressions_file, num_threads);
 }
 
-#if USE_XLSX
-void RegexAnalyzer::writeXLSXResults(const std::string& output_filename) {
-    // Create workbook
-    lxw_workbook* workbook = workbook_new(output_filename.c_str());
-    if (!workbook) {
-        throw std::runtime_error("Failed to create Excel workbook: " + output_filename);
+void RegexAnalyzer::analyzeBatch(const std::vector<std::pair<std::string, std::string>>& roots,
+                                 const std::string& expressions_file, int num_threads) {
+    targets.clear();
+    for (const auto& root : roots) {
+        targets.emplace_back(root.first, root.second);
     }
+    run(expressions_file, num_threads);
     
-    // Create formats
-    lxw_format* header_format = workbook_add_format(workbook);
-    format_set_bold(header_format);
-    format_set_bg_color(header_format, LXW_COLOR_GRAY);
-    format_set_border(header_format, LXW_BORDER_THIN);
-    
-    lxw_format* cell_format = workbook_add_format(workbook);
-    format_set_border(cell_format, LXW_BORDER_THIN);
-    format_set_text_wrap(cell_format);
-    
-    // Group findings by expression
-    std::map<std::string, std::vector<Finding>> grouped_findings;
+    std::cout << "Per-root results:" << std::endl;
+    for (const auto& target : targets) {
+        std::cout << "  " << target.directory << ": " << target.text_files.load() << " text files, "
+                  << target.findings.load() << " matches -> " << target.output_file << std::endl;
+    }
+}
+
+std::vector<std::pair<std::string, std::string>> RegexAnalyzer::loadManifest(const std::string& filename) {
+    std::vector<std::pair<std::string, std::string>> roots;
+    std::ifstream file(filename);
     
-    for (const auto& finding : all_findings) {
-        grouped_findings[finding.expression_name].push_back(finding);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open batch manifest: " + filename);
     }
     
-    // Create worksheet for each expression
-    for (const auto& [expr_name, findings] : grouped_findings) {
-        // Clean sheet name (Excel has restrictions on sheet names)
-        std::string sheet_name = expr_name;
-        // Replace invalid characters
-        for (char& c : sheet_name) {
-            if (c == '\\' || c == '/' || c == '?' || c == '*' || c == '[' || c == ']' || c == ':') {
-                c = '_';
-            }
-        }
-        // Limit to 31 characters (Excel limit)
-        if (sheet_name.length() > 31) {
-            sheet_name = sheet_name.substr(0, 31);
-        }
-        
-        lxw_worksheet* worksheet = workbook_add_worksheet(workbook, sheet_name.c_str());
-        if (!worksheet) {
-            std::cerr << "Failed to create worksheet: " << sheet_name << std::endl;
-            continue;
-        }
-        
-        // Set column widths
-        worksheet_set_column(worksheet, 0, 0, 20, nullptr); // Finding
-        worksheet_set_column(worksheet, 1, 1, 40, nullptr); // File
-        worksheet_set_column(worksheet, 2, 2, 10, nullptr); // Line
-        worksheet_set_column(worksheet, 3, 3, 20, nullptr); // Comments
-        worksheet_set_column(worksheet, 4, 4, 15, nullptr); // Ease
-        worksheet_set_column(worksheet, 5, 5, 15, nullptr); // Significance
-        worksheet_set_column(worksheet, 6, 6, 15, nullptr); // Risk
-        worksheet_set_column(worksheet, 7, 7, 60, nullptr); // Statement
+    std::string line;
+    bool in_roots_section = false;
+    std::map<std::string, std::string> output_owners;   // Output base name -> directory writing it
+    
+    while (std::getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r\n"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
         
-        // Write headers
-        worksheet_write_string(worksheet, 0, 0, "Finding", header_format);
-        worksheet_write_string(worksheet, 0, 1, "File", header_format);
-        worksheet_write_string(worksheet, 0, 2, "Line", header_format);
-        worksheet_write_string(worksheet, 0, 3, "Comments", header_format);
-        worksheet_write_string(worksheet, 0, 4, "Ease", header_format);
-        worksheet_write_string(worksheet, 0, 5, "Significance", header_format);
-        worksheet_write_string(worksheet, 0, 6, "Risk", header_format);
-        worksheet_write_string(worksheet, 0, 7, "Statement", header_format);
+        if (line.empty() || line[0] == '#') continue;
         
-        // Write findings
-        int row = 1;
-        for (const auto& finding : findings) {
-            worksheet_write_string(worksheet, row, 0, finding.actual_match.c_str(), cell_format);  // Actual match
-            worksheet_write_string(worksheet, row, 1, finding.filename.c_str(), cell_format);
-            worksheet_write_number(worksheet, row, 2, finding.line_number, cell_format);
-            worksheet_write_string(worksheet, row, 3, "", cell_format); // Comments (blank)
-            worksheet_write_string(worksheet, row, 4, "", cell_format); // Ease (blank)
-            worksheet_write_string(worksheet, row, 5, "", cell_format); // Significance (blank)
-            worksheet_write_string(worksheet, row, 6, "", cell_format); // Risk (blank)
-            worksheet_write_string(worksheet, row, 7, finding.statement.c_str(), cell_format);     // Full line
-            row++;
+        if (line[0] == '[' && line.back() == ']') {
+            in_roots_section = (line == "[roots]");
+            continue;
         }
         
-        // Freeze the header row so it stays visible when scrolling
-        worksheet_freeze_panes(worksheet, 1, 0);
-        
-        std::cout << "Created sheet: " << sheet_name << " with " << findings.size() << " findings" << std::endl;
-    }
-    
-    // Create a summary worksheet with all findings
-    if (!all_findings.empty()) {
-        lxw_worksheet* summary_worksheet = workbook_add_worksheet(workbook, "Summary");
-        if (summary_worksheet) {
-            // Set column widths
-            worksheet_set_column(summary_worksheet, 0, 0, 20, nullptr); // Finding
-            worksheet_set_column(summary_worksheet, 1, 1, 40, nullptr); // File
-            worksheet_set_column(summary_worksheet, 2, 2, 10, nullptr); // Line
-            worksheet_set_column(summary_worksheet, 3, 3, 20, nullptr); // Comments
-            worksheet_set_column(summary_worksheet, 4, 4, 15, nullptr); // Ease
-            worksheet_set_column(summary_worksheet, 5, 5, 15, nullptr); // Significance
-            worksheet_set_column(summary_worksheet, 6, 6, 15, nullptr); // Risk
-            worksheet_set_column(summary_worksheet, 7, 7, 60, nullptr); // Statement
-            
-            // Write headers
-            worksheet_write_string(summary_worksheet, 0, 0, "Finding", header_format);
-            worksheet_write_string(summary_worksheet, 0, 1, "File", header_format);
-            worksheet_write_string(summary_worksheet, 0, 2, "Line", header_format);
-            worksheet_write_string(summary_worksheet, 0, 3, "Comments", header_format);
-            worksheet_write_string(summary_worksheet, 0, 4, "Ease", header_format);
-            worksheet_write_string(summary_worksheet, 0, 5, "Significance", header_format);
-            worksheet_write_string(summary_worksheet, 0, 6, "Risk", header_format);
-            worksheet_write_string(summary_worksheet, 0, 7, "Statement", header_format);
-            
-            // Write all findings
-            int row = 1;
-            for (const auto& finding : all_findings) {
-                worksheet_write_string(summary_worksheet, row, 0, finding.actual_match.c_str(), cell_format);  // Actual match
-                worksheet_write_string(summary_worksheet, row, 1, finding.filename.c_str(), cell_format);
-                worksheet_write_number(summary_worksheet, row, 2, finding.line_number, cell_format);
-                worksheet_write_string(summary_worksheet, row, 3, "", cell_format); // Comments (blank)
-                worksheet_write_string(summary_worksheet, row, 4, "", cell_format); // Ease (blank)
-                worksheet_write_string(summary_worksheet, row, 5, "", cell_format); // Significance (blank)
-                worksheet_write_string(summary_worksheet, row, 6, "", cell_format); // Risk (blank)
-                worksheet_write_string(summary_worksheet, row, 7, finding.statement.c_str(), cell_format);     // Full line
-                row++;
+        if (in_roots_section) {
+            // Parse output_file=directory
+            size_t eq_pos = line.find('=');
+            if (eq_pos == std::string::npos) {
+                std::cerr << "Warning: Ignoring manifest line without '=': " << line << std::endl;
+                continue;
+            }
+            std::string output_file = line.substr(0, eq_pos);
+            std::string directory = line.substr(eq_pos + 1);
+            output_file.erase(output_file.find_last_not_of(" \t") + 1);
+            directory.erase(0, directory.find_first_not_of(" \t"));
+            if (output_file.empty() || directory.empty()) {
+                std::cerr << "Warning: Ignoring incomplete manifest line: " << line << std::endl;
+                continue;
             }
             
-            // Freeze the header row so it stays visible when scrolling
-            worksheet_freeze_panes(summary_worksheet, 1, 0);
-            
-            std::cout << "Created Summary sheet with " << all_findings.size() << " total findings" << std::endl;
+            // Every format writes its file from the base name, so two roots whose output
+            // names differ only in extension would overwrite each other
+            std::string base = std::filesystem::path(output_file).lexically_normal().replace_extension().string();
+            auto owner = output_owners.emplace(base, directory);
+            if (!owner.second) {
+                throw std::runtime_error("Batch manifest " + filename + " writes " + output_file + " for both " + 
+                                         owner.first->second + " and " + directory);
+            }
+            roots.emplace_back(directory, output_file);
         }
     }
     
-    // Close workbook
-    lxw_error error = workbook_close(workbook);
-    if (error != LXW_NO_ERROR) {
-        throw std::runtime_error("Failed to save Excel workbook: " + std::string(lxw_strerror(error)));
+    if (roots.empty()) {
+        throw std::runtime_error("No roots found in batch manifest: " + filename);
     }
-    
-    std::cout << "Successfully created Excel file: " << output_filename << std::endl;
+    return roots;
 }
-#endif
 
-void RegexAnalyzer::writeXMLSpreadsheetResults(const std::string& output_filename) {
-    // Ensure .xml extension
-    std::string xml_filename = output_filename;
-    if (xml_filename.find_last_of('.') == std::string::npos) {
-        xml_filename += ".xml";
-    } else {
-        size_t dot_pos = xml_filename.find_last_of('.');
-        std::string ext = xml_filename.substr(dot_pos);
-        if (ext != ".xml") {
-            xml_filename = xml_filename.substr(0, dot_pos) + ".xml";
+void RegexAnalyzer::run(const std::string& expressions_file, int num_threads) {
+    auto analyze_start = std::chrono::steady_clock::now();
+    stage_timings = StageTimings();
+    detect_ns = 0;
+    match_ns = 0;
+    write_ns = 0;
+    
+    std::cout << "Loading expressions from: " << expressions_file << std::endl;
+    compileExpressions(expressions_file);
+    
+    std::cout << "Literal prefilter applies to " << prefilter.filteredCount() << " of " 
+              << expressions.size() << " expressions" << std::endl;
+    
+    // Nested quantifiers can backtrack exponentially; the linear matcher finds the same
+    // matches without that risk
+    linear_only.assign(expressions.size(), 0);
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        if (expressions[i].nested_quantifier && automaton.covers(i)) {
+            linear_only[i] = 1;
+            if (verbose) {
+                std::cout << "Expression " << expressions[i].name << " has nested quantifiers; using the linear matcher" << std::endl;
+            }
         }
     }
+    size_t linear_count = static_cast<size_t>(std::count(linear_only.begin(), linear_only.end(), 1));
+    if (linear_count > 0) {
+        std::cout << "Linear matcher runs " << linear_count << " of " << expressions.size() 
+                  << " expressions (nested quantifiers)" << std::endl;
+    }
+    if (match_engine == MatchEngine::AUTOMATON) {
+        std::cout << "Automaton engine covers " << automaton.coveredCount() << " of " 
+                  << expressions.size() << " expressions" << std::endl;
+    }
     
-    XMLSpreadsheetWriter writer(xml_filename);
-    if (!writer.isOpen()) {
-        throw std::runtime_error("Failed to create XML spreadsheet: " + xml_filename);
+    if (!cache_file.empty()) {
+        if (cache.load(cache_file, expressionSetHash(), expressions.size())) {
+            std::cout << "Loaded " << cache.loadedCount() << " cached file entries from " << cache_file << std::endl;
+        } else {
+            std::cout << "No usable scan cache at " << cache_file << "; scanning every file" << std::endl;
+        }
     }
     
-    // Group findings by expression
-    std::map<std::string, std::vector<Finding>> grouped_findings;
+    // Sinks are opened up front so streaming formats fill in as files finish
+    openSinks();
+    for (const auto& target : targets) {
+        std::cout << "Writing results to: " << target.output_file << std::endl;
+        std::cout << "Scanning directory: " << target.directory << std::endl;
+    }
+    std::cout << "Starting analysis with " << num_threads << " threads..." << std::endl;
     
-    for (const auto& finding : all_findings) {
-        grouped_findings[finding.expression_name].push_back(finding);
+    file_queue.clear();
+    discovery_done = false;
+    busy_workers = 0;
+    worker_count = num_threads;
+    ready_queue.clear();
+    feeding_done = false;
+    reads_in_flight = 0;
+    read_ahead_bytes = 0;
+    text_file_count = 0;
+    progress.setTotal(0);
+    progress.start();
+    all_findings.reset(static_cast<size_t>(std::max(0, num_threads)));
+    file_records.clear();
+    cached_file_count = 0;
+    finding_count = 0;
+    profile.reset(expressions.size());
+    diagnostics.clear();
+    
+    // Read-ahead keeps its own number of reads in flight, apart from the matching threads
+    std::unique_ptr<ReadAhead> reader;
+    std::thread feeder;
+    if (read_ahead_depth > 0) {
+        reader = std::make_unique<ReadAhead>(read_ahead_depth);
+        std::cout << "Reading ahead with up to " << read_ahead_depth << " reads in flight ("
+                  << (reader->usesIoUring() ? "io_uring" : "reader threads") << ")" << std::endl;
+        feeder = std::thread(&RegexAnalyzer::feederThread, this, std::ref(*reader));
     }
     
-    // Create worksheet for each expression
-    for (const auto& [expr_name, findings] : grouped_findings) {
-        writer.addWorksheet(expr_name);
-        
-        // Add header row
-        writer.addRow(expr_name, {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
-        
-        // Add findings
-        for (const auto& finding : findings) {
-            writer.addRow(expr_name, {
-                finding.actual_match,        // Actual regex match
-                finding.filename,
-                std::to_string(finding.line_number),
-                "", // Comments (blank)
-                "", // Ease (blank)
-                "", // Significance (blank)
-                "", // Risk (blank)
-                finding.statement            // Full line
-            });
-        }
-        
-        std::cout << "Created sheet: " << expr_name << " with " << findings.size() << " findings" << std::endl;
+    // Launch worker threads; they start matching as soon as discovery yields files
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(&RegexAnalyzer::workerThread, this, static_cast<size_t>(i));
     }
     
-    // Create a summary worksheet with all findings
-    if (!all_findings.empty()) {
-        writer.addWorksheet("Summary");
-        
-        // Add header row
-        writer.addRow("Summary", {"Finding", "File", "Line", "Comments", "Ease", "Significance", "Risk", "Statement"});
-        
-        // Add all findings
-        for (const auto& finding : all_findings) {
-            writer.addRow("Summary", {
-                finding.actual_match,        // Actual regex match
-                finding.filename,
-                std::to_string(finding.line_number),
-                "", // Comments (blank)
-                "", // Ease (blank)
-                "", // Significance (blank)
-                "", // Risk (blank)
-                finding.statement            // Full line
-            });
+    auto walk_start = std::chrono::steady_clock::now();
+    size_t discovered = findTextFiles(num_threads);
+    stage_timings.walk_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - walk_start).count();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        discovery_done = true;
+    }
+    queue_cv.notify_all();
+    progress.finishTotal();
+    
+    // Wait for all threads to complete
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (feeder.joinable()) {
+        feeder.join();
+    }
+    reader.reset();
+    progress.stop();
+    
+    std::cout << std::endl << "Found " << text_file_count.load() << " text files (" 
+              << discovered << " files discovered)" << std::endl;
+    
+    if (!cache_file.empty()) {
+        std::cout << "Reused cached results for " << cached_file_count.load() << " of " 
+                  << discovered << " files" << std::endl;
+        if (cache.save(cache_file, file_records, all_findings)) {
+            std::cout << "Saved scan cache to " << cache_file << std::endl;
+        } else {
+            std::cerr << "Warning: Could not write scan cache: " << cache_file << std::endl;
         }
-        
-        std::cout << "Created Summary sheet with " << all_findings.size() << " total findings" << std::endl;
     }
     
-    if (!writer.writeFile()) {
-        throw std::runtime_error("Failed to write XML spreadsheet file");
+    reportDiagnostics();
+    
+    if (text_file_count == 0) {
+        std::cout << "No text files found to process" << std::endl;
+    } else {
+        std::cout << "Analysis complete. Found " << finding_count.load() << " matches" << std::endl;
     }
     
-    std::cout << "Successfully created XML Spreadsheet file: " << xml_filename << std::endl;
-    std::cout << "This file can be opened in Excel, LibreOffice Calc, or Google Sheets" << std::endl;
+    writeResults();
+    
+    if (profiling) {
+        profile.print(expressions);
+        if (!profile_file.empty()) {
+            if (profile.writeJson(profile_file, expressions)) {
+                std::cout << "Wrote expression profile to " << profile_file << std::endl;
+            } else {
+                std::cerr << "Warning: Could not write expression profile: " << profile_file << std::endl;
+            }
+        }
+    }
+    
+    stage_timings.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - analyze_start).count();
+    stage_timings.detect_seconds = detect_ns / 1e9;
+    stage_timings.match_seconds = match_ns / 1e9;
+    stage_timings.write_seconds = write_ns / 1e9;
+    stage_timings.files = text_file_count;
+    stage_timings.bytes = progress.byteCount();
+    stage_timings.findings = finding_count;
+}
+
+bool parseMatchEngine(const std::string& name, MatchEngine& engine) {
+    if (name == "automaton") {
+        engine = MatchEngine::AUTOMATON;
+    } else if (name == "std-regex") {
+        engine = MatchEngine::STD_REGEX;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseNonNegative(const char* text, long& value) {
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
 }
 
 void printUsage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " <directory> <expressions_file> <output_file> [num_threads]" << std::endl;
+    std::cout << "Usage: " << program_name << " [options] <directory> <expressions_file> <output_file> [num_threads]" << std::endl;
     std::cout << "  directory:        Directory to search for text files" << std::endl;
     std::cout << "  expressions_file: Path to expressions.properties file" << std::endl;
     std::cout << "  output_file:      Base name for output files" << std::endl;
     std::cout << "  num_threads:      Number of worker threads (default: 4)" << std::endl;
     std::cout << std::endl;
+    std::cout << "       " << program_name << " [options] --batch <manifest> <expressions_file> [num_threads]" << std::endl;
+    std::cout << "  manifest:         Roots to scan with one worker pool, one output per root" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --cache <file>    Reuse results for unchanged files from <file> and update it" << std::endl;
+    std::cout << "  --pattern-cache <file>  Reuse the compiled expression set from <file> while the" << std::endl;
+    std::cout << "                    expressions file is unchanged, rebuilding it otherwise" << std::endl;
+    std::cout << "  -v, --verbose     Log every expression and file as it is processed" << std::endl;
+    std::cout << "  --engine <name>   Matching engine: automaton (combined lazy DFAs locate every match," << std::endl;
+    std::cout << "                    default) or std-regex (one std::regex pass per expression)" << std::endl;
+    std::cout << "  --regex-budget <ms>  std::regex time per file and expression before the linear" << std::endl;
+    std::cout << "                    matcher takes over (default: 1000)" << std::endl;
+    std::cout << "  --read-ahead <depth>  Keep <depth> whole-file reads in flight ahead of the" << std::endl;
+    std::cout << "                    matching threads, through io_uring when available (default: 0," << std::endl;
+    std::cout << "                    files are mapped by the matching threads)" << std::endl;
+    std::cout << "  --profile         Report per-expression regex time and flag slow patterns" << std::endl;
+    std::cout << "  --profile-json <file>  Also write that report as JSON to <file>" << std::endl;
+    std::cout << "  --format <list>   Comma-separated output formats: xlsx, xml, jsonl, csv, bin" << std::endl;
+    std::cout << "                    (default: xlsx when available, otherwise xml). Each format" << std::endl;
+    std::cout << "                    writes <output_file> with its own extension; jsonl, csv," << std::endl;
+    std::cout << "                    bin and xml are written while the scan runs" << std::endl;
+    std::cout << std::endl;
     std::cout << "Example expressions.properties format:" << std::endl;
     std::cout << "[expressions]" << std::endl;
     std::cout << "expression.url=https?://[\\w.-]+[\\w/]+" << std::endl;
     std::cout << "expression.ip=\\b(?:[0-9]{1,3}\\.){3}[0-9]{1,3}\\b" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Example batch manifest format (output_file=directory):" << std::endl;
+    std::cout << "[roots]" << std::endl;
+    std::cout << "results/share-a=/mnt/share-a" << std::endl;
+    std::cout << "results/share-b=/mnt/share-b" << std::endl;
 }
 
+#ifndef WHISTLE_NO_MAIN
 int main(int argc, char* argv[]) {
-    if (argc < 4 || argc > 5) {
+    std::vector<std::string> args;
+    std::string cache_file;
+    std::string pattern_cache_file;
+    std::vector<std::string> output_formats;
+    bool verbose = false;
+    bool profile = false;
+    std::string profile_file;
+    std::string manifest_file;             // Batch mode when set
+    long regex_budget_ms = 1000;
+    long read_ahead_depth = 0;
+    MatchEngine match_engine = MatchEngine::AUTOMATON;
+    
+    // Options may appear anywhere; everything else is positional
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cache" && i + 1 < argc) {
+            cache_file = argv[++i];
+        } else if (arg == "--pattern-cache" && i + 1 < argc) {
+            pattern_cache_file = argv[++i];
+        } else if (arg == "--verbose" || arg == "-v") {
+            verbose = true;
+        } else if (arg == "--engine" && i + 1 < argc) {
+            if (!parseMatchEngine(argv[++i], match_engine)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--regex-budget" && i + 1 < argc) {
+            if (!parseNonNegative(argv[++i], regex_budget_ms)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--read-ahead" && i + 1 < argc) {
+            if (!parseNonNegative(argv[++i], read_ahead_depth)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--profile-json" && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            manifest_file = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string format;
+            while (std::getline(list, format, ',')) {
+                if (!format.empty()) {
+                    output_formats.push_back(format);
+                }
+            }
+        } else if (arg.rfind("-", 0) == 0 && arg.size() > 1) {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    
+    bool batch = !manifest_file.empty();
+    size_t min_args = batch ? 1 : 3;
+    if (args.size() < min_args || args.size() > min_args + 1) {
         printUsage(argv[0]);
         return 1;
     }
     
-    std::string directory = argv[1];
-    std::string expressions_file = argv[2];
-    std::string output_file = argv[3];
-    int num_threads = (argc == 5) ? std::stoi(argv[4]) : 4;
+    std::string directory = batch ? std::string() : args[0];
+    std::string expressions_file = batch ? args[0] : args[1];
+    std::string output_file = batch ? std::string() : args[2];
+    int num_threads = (args.size() == min_args + 1) ? std::stoi(args[min_args]) : 4;
     
+    if (output_formats.empty()) {
 #if USE_XLSX
-    std::cout << "Using XLSX output format" << std::endl;
+        std::cout << "Using XLSX output format" << std::endl;
 #else
-    std::cout << "Using XML Spreadsheet 2003 output format (XLSX library not available)" << std::endl;
+        std::cout << "Using XML Spreadsheet 2003 output format (XLSX library not available)" << std::endl;
 #endif
+    }
     
     try {
         RegexAnalyzer analyzer;
-        analyzer.analyze(directory, expressions_file, output_file, num_threads);
+        analyzer.setCacheFile(cache_file);
+        analyzer.setPatternCacheFile(pattern_cache_file);
+        analyzer.setOutputFormats(output_formats);
+        analyzer.setVerbose(verbose);
+        analyzer.setMatchEngine(match_engine);
+        analyzer.setProfile(profile, profile_file);
+        analyzer.setRegexBudget(std::chrono::milliseconds(regex_budget_ms));
+        analyzer.setReadAhead(static_cast<size_t>(read_ahead_depth));
+        if (batch) {
+            analyzer.analyzeBatch(RegexAnalyzer::loadManifest(manifest_file), expressions_file, num_threads);
+        } else {
+            analyzer.analyze(directory, expressions_file, output_file, num_threads);
+        }
         
         std::cout << "Analysis completed successfully!" << std::endl;
         return 0;
@@ -954,3 +5171,4 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 }
+#endif // WHISTLE_NO_MAIN
@@ -16,6 +16,53 @@
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <charconv>
+#include <string_view>
+#include <initializer_list>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <bitset>
+#include <memory>
+#include <array>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// io_uring is driven through raw syscalls, so only the kernel header is needed.
+// Build with -DUSE_IO_URING=0 to always use the reader-thread fallback.
+#ifndef USE_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING 1
+#endif
+#endif
+#endif
+#ifndef USE_IO_URING
+#define USE_IO_URING 0
+#endif
+#if USE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Check for libxlsxwriter availability
 #ifdef HAVE_XLSXWRITER
@@ -25,77 +72,1149 @@
 #define USE_XLSX 0
 #endif
 
-// XML Spreadsheet 2003 writer (fallback when XLSX not available)
+// One spreadsheet cell. Text is referenced, not copied, so it only has to stay alive
+// for the addRow() call; integers are written as Number cells.
+struct SpreadsheetCell {
+    std::string_view text;
+    long long number = 0;
+    bool is_number = false;
+    
+    SpreadsheetCell(const char* value) : text(value) {}
+    SpreadsheetCell(const std::string& value) : text(value) {}
+    SpreadsheetCell(std::string_view value) : text(value) {}
+    SpreadsheetCell(int value) : number(value), is_number(true) {}
+};
+
+// XML Spreadsheet 2003 writer (fallback when XLSX not available). Rows are rendered
+// as they are added and each worksheet spills to an anonymous temp file once the
+// buffered rows of all sheets exceed buffer_limit, so memory does not grow with the
+// row count. writeFile() splices the sheets together.
 class XMLSpreadsheetWriter {
 private:
+    struct Worksheet {
+        std::string buffer;           // Rendered rows not yet spilled
+        std::FILE* spill = nullptr;   // Rendered rows already spilled, in order
+        size_t row_count = 0;
+    };
+    
+    std::vector<char> file_buffer;    // Large user-space buffer behind the ofstream
     std::ofstream file;
-    std::map<std::string, std::vector<std::vector<std::string>>> worksheets;
+    std::map<std::string, Worksheet> worksheets;
+    size_t buffer_limit;
+    size_t buffered_bytes = 0;
     
     std::string escapeXML(const std::string& text);
+    static void appendEscaped(std::string& out, std::string_view text);
     std::string cleanSheetName(const std::string& name);
+    void spillWorksheets();
     
 public:
-    XMLSpreadsheetWriter(const std::string& filename);
+    static const size_t DEFAULT_BUFFER_LIMIT = 16 * 1024 * 1024;
+    static const size_t FILE_BUFFER_SIZE = 1024 * 1024;
+    
+    XMLSpreadsheetWriter(const std::string& filename, size_t buffer_limit = DEFAULT_BUFFER_LIMIT);
     ~XMLSpreadsheetWriter();
     
+    XMLSpreadsheetWriter(const XMLSpreadsheetWriter&) = delete;
+    XMLSpreadsheetWriter& operator=(const XMLSpreadsheetWriter&) = delete;
+    
     void addWorksheet(const std::string& name);
-    void addRow(const std::string& worksheet_name, const std::vector<std::string>& row);
+    void addRow(const std::string& worksheet_name, std::initializer_list<SpreadsheetCell> row);
     bool writeFile();
     bool isOpen() const;
 };
 
+// Compact match record. Names and text live in RegexAnalyzer's interned tables and are
+// only turned back into strings when results are written.
 struct Finding {
-    std::string expression_name;
-    std::string filename;
-    int line_number;
-    std::string actual_match;  // The actual text that matched the regex
-    std::string statement;     // The full line containing the match
+    uint32_t expression_id;      // Index into the loaded expressions
+    uint32_t file_id;            // Index into the interned file table
+    uint32_t line_number;
+    uint32_t match_offset;       // Start of the actual match within the statement
+    uint32_t match_length;
+    uint32_t statement_length;   // The full line(s) containing the match
+    uint64_t statement_offset;   // Start of the statement in the file's line store
 };
 
+// Interned per-file data that Findings point into
+struct FileRecord {
+    std::string path;
+    std::string lines;           // Statements of this file's findings, each line stored once
+    uint32_t target = 0;         // Index of the scan target (root) the file was found under
+};
+
+// A loaded expression. Move-only: workers share the analyzer's expressions by reference.
 struct ExpressionPattern {
     std::string name;
-    std::regex pattern;
+    std::string source;        // Pattern text with any inline (?i)/(?-i) flag removed
+    bool icase = true;
+    std::vector<std::string> required_literals;  // Lowercased; every match contains one (empty = unknown)
+    bool nested_quantifier = false;              // An unbounded repeat of a repeat, e.g. (a+)+
+    
+    ExpressionPattern(std::string name, std::string source, bool icase);
+    
+    // Built on first use from any thread, so an expression set loaded from the pattern
+    // cache only pays for the std::regex objects a scan needs. Throws std::regex_error.
+    const std::regex& regex() const;
+    
+private:
+    mutable std::unique_ptr<std::once_flag> compile_once = std::make_unique<std::once_flag>();
+    mutable std::regex pattern;
+};
+
+// Bounds-checked reader over serialized bytes, such as a memory-mapped cache file
+class ByteReader {
+private:
+    const char* position;
+    const char* end;
+    
+public:
+    ByteReader(const char* data, size_t size) : position(data), end(data + size) {}
+    
+    template <typename T>
+    bool read(T& value) {
+        if (static_cast<size_t>(end - position) < sizeof(T)) return false;
+        std::memcpy(&value, position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+    
+    template <typename T>
+    bool readVector(std::vector<T>& values) {   // Length-prefixed array of trivially copyable T
+        uint64_t count;
+        if (!read(count) || count > static_cast<size_t>(end - position) / sizeof(T)) return false;
+        values.resize(static_cast<size_t>(count));
+        if (count > 0) std::memcpy(values.data(), position, static_cast<size_t>(count) * sizeof(T));
+        position += count * sizeof(T);
+        return true;
+    }
+    
+    bool readString(std::string& text);
+    size_t remaining() const { return static_cast<size_t>(end - position); }
+    bool atEnd() const { return position == end; }
+};
+
+// Matching engine used by RegexAnalyzer::processFile
+enum class MatchEngine {
+    STD_REGEX,   // One std::regex pass per expression over every segment
+    AUTOMATON    // Combined lazy-DFA passes locate matches; std::regex only confirms each one
+};
+
+// Syntax tree for the subset of ECMAScript regex understood by PatternAutomaton
+struct RegexNode {
+    enum class Kind { Empty, Bytes, Concat, Alternate, Repeat, WordBoundary, NotWordBoundary };
+    
+    Kind kind = Kind::Empty;
+    std::bitset<256> bytes;    // Bytes: accepted byte values
+    int min_repeat = 0;        // Repeat: lower bound
+    int max_repeat = -1;       // Repeat: upper bound, -1 for unbounded
+    bool greedy = true;        // Repeat: greedy or lazy
+    std::vector<std::unique_ptr<RegexNode>> children;
+};
+
+// Recursive descent parser; throws std::runtime_error on syntax it cannot represent
+// (anchors, back-references, lookaheads), in which case std::regex handles the pattern alone
+class RegexSyntaxParser {
+private:
+    const std::string& pattern;
+    size_t pos = 0;
+    bool icase;
+    
+    std::unique_ptr<RegexNode> parseAlternation();
+    std::unique_ptr<RegexNode> parseConcatenation();
+    std::unique_ptr<RegexNode> parseRepeat();
+    std::unique_ptr<RegexNode> parseAtom();
+    std::unique_ptr<RegexNode> parseClass();
+    std::unique_ptr<RegexNode> parseEscape();
+    bool parseClassEscape(std::bitset<256>& set, int& single_byte);
+    bool parseBound(int& value);
+    std::unique_ptr<RegexNode> makeBytes(std::bitset<256> set) const;
+    
+public:
+    RegexSyntaxParser(const std::string& pattern, bool icase);
+    std::unique_ptr<RegexNode> parse();
+};
+
+// True when an unbounded repeat contains another repeat that can take more than one
+// iteration, the shape that makes a backtracking engine explore exponentially many paths
+bool hasNestedQuantifier(const RegexNode& node);
+
+// Aho-Corasick automaton over the case-folded required literals of every expression.
+// Expressions without required literals are always reported as candidates.
+class LiteralPrefilter {
+private:
+    struct Node {
+        std::array<int, 256> next;
+        std::vector<int> expressions;    // Expressions whose literal ends here (including via suffix links)
+    };
+    
+    std::vector<Node> nodes;
+    std::vector<char> always_candidate;
+    size_t filtered_count = 0;
+    std::vector<unsigned char> first_bytes;  // Raw bytes that can start a literal, both cases
+    bool first_byte[256] = {};
+    
+    const char* skipToCandidate(const char* p, const char* end) const;
+    
+public:
+    // Extracts a set of lowercased literals at least one of which occurs in every match of root
+    static std::vector<std::string> requiredLiterals(const RegexNode& root);
+    
+    void build(const std::vector<ExpressionPattern>& expressions);
+    size_t filteredCount() const;
+    void save(std::ostream& out) const;
+    bool load(ByteReader& in);
+    
+    // Sets candidates[i] for every expression that may match somewhere in [begin, end)
+    void scan(const char* begin, const char* end, std::vector<char>& candidates) const;
+};
+
+// Thompson NFA built from every supported expression, with match states tagged by expression index.
+// A reversed automaton reads every expression backwards; run from a match end towards the
+// start of the input, it finds where matches begin.
+class PatternAutomaton {
+public:
+    struct State {
+        enum Type : uint8_t { Bytes, Split, Epsilon, WordBoundary, NotWordBoundary, Match };
+        Type type = Epsilon;
+        int out = -1;          // Next state (Split: preferred branch)
+        int out1 = -1;         // Split: alternative branch
+        int byte_set = -1;     // Bytes: index into byte_sets
+        int match_id = -1;     // Match: expression index
+    };
+    
+private:
+    std::vector<State> states;
+    std::vector<std::bitset<256>> byte_sets;
+    std::vector<int> start_states;
+    std::vector<int> expression_starts;   // Per expression: its fragment's entry state, -1 if not covered
+    std::vector<char> covered;
+    size_t covered_count = 0;
+    unsigned char byte_class[256] = {};
+    int num_classes = 1;
+    bool reversed = false;
+    
+    int addState(State state);
+    int compileNode(const RegexNode& node, int next);
+    void buildByteClasses();
+    
+    friend class AutomatonScanner;
+    friend class LinearMatcher;
+    
+public:
+    void compile(const std::vector<ExpressionPattern>& expressions, bool reverse = false, bool verbose = false);
+    void save(std::ostream& out) const;
+    bool load(ByteReader& in, size_t expression_count);
+    bool covers(size_t expression_index) const;
+    size_t coveredCount() const;
+};
+
+// Per-thread lazy DFA over a shared PatternAutomaton. States are built on demand and
+// the cache is flushed when it grows past MAX_DFA_STATES.
+class AutomatonScanner {
+private:
+    struct DfaState {
+        std::vector<int> nfa_states;         // Closure with word-boundary assertions unresolved
+        bool prev_word = false;              // Whether the byte before this state was a word byte
+        bool anchored = false;               // No new match attempts start (follows earlier attempts only)
+        std::vector<int> next;               // Transition per byte class, -1 if not built yet
+        std::vector<int> matches_next_word;  // Expressions matching here if the next byte is a word byte
+        std::vector<int> matches_next_other; // Expressions matching here otherwise (or at end of input)
+    };
+    
+    static const size_t MAX_DFA_STATES = 4096;
+    
+    const PatternAutomaton& automaton;
+    std::vector<DfaState> dfa;
+    std::map<std::vector<int>, int> dfa_index;
+    std::vector<uint32_t> visit_mark;
+    uint32_t visit_generation = 0;
+    std::vector<int> expression_of;          // Per NFA state: the expression whose fragment holds it
+    int lane = -1;                           // Attempts from before the last scan's split, at its end
+    
+    void addClosure(int state, bool resolve, bool prev_word, bool next_word, std::vector<int>& out);
+    void beginClosure();
+    int findOrAddState(std::vector<int> nfa_states, bool prev_word, bool anchored);
+    int startState(bool prev_word = false);
+    int step(int current, unsigned char byte);
+    void flush(std::initializer_list<int*> keep);   // Empties the cache, renumbering the states in keep
+    
+public:
+    explicit AutomatonScanner(const PatternAutomaton& automaton);
+    
+    // Sets hits[i] for every covered expression i with at least one match in [begin, end).
+    // With split and live, also sets live[i] when an attempt of i starting before split
+    // is still running at end, so a match of i from before split may continue past end.
+    // With ends, scans all of [begin, end) and sets ends[i] to the offset from begin of
+    // the last position where a match of i ends.
+    void scan(const char* begin, const char* end, std::vector<char>& hits,
+              const char* split = nullptr, std::vector<char>* live = nullptr,
+              std::vector<size_t>* ends = nullptr);
+    
+    // Over a reversed automaton: reads [begin, end) backwards and appends to starts[i],
+    // in decreasing order, the offset from begin of every position where a match of i
+    // that ends by end begins, for each expression with wanted[i] set. after_word and
+    // before_word tell whether the bytes just past end and just before begin are word
+    // bytes; a byte past the input is not.
+    void scanBackward(const char* begin, const char* end, bool after_word, bool before_word,
+                      const std::vector<char>& wanted, std::vector<std::vector<uint32_t>>& starts);
+    
+    // Follows the last scan's running attempts of one expression on from that scan's end
+    // (p) and returns where the last of them dies, or end
+    const char* liveUntil(size_t expression_index, const char* p, const char* end);
+};
+
+// Leftmost-first matcher for a single covered expression. It simulates the automaton
+// with threads kept in priority order (a Pike VM), so it reports the match a
+// backtracking engine would while staying linear in the input for any pattern.
+class LinearMatcher {
+private:
+    struct Thread {
+        int state;
+        const char* start;
+    };
+    
+    const PatternAutomaton& automaton;
+    std::vector<Thread> current;
+    std::vector<Thread> next;
+    std::vector<int> stack;
+    std::vector<uint32_t> visit_mark;
+    uint32_t visit_generation = 0;
+    
+    void beginStep();
+    void addThread(std::vector<Thread>& list, int state, const char* start, bool prev_word, bool next_word);
+    bool search(size_t expression_index, const char* begin, const char* attempts_end, const char* end,
+                bool prev_avail, bool open, const char*& match_begin, const char*& match_end, const char*& live);
+    
+public:
+    explicit LinearMatcher(const PatternAutomaton& automaton);
+    
+    // Finds the first match of the expression starting in [begin, end); the input ends at
+    // end. begin[-1] is read for word boundaries when prev_avail is set.
+    bool find(size_t expression_index, const char* begin, const char* end, bool prev_avail,
+              const char*& match_begin, const char*& match_end);
+    
+    // Like find for input that continues past end, with attempts starting only before
+    // attempts_end. live is set to the start of the leftmost attempt that would still
+    // outrank any match found but is running at end, or to nullptr when the result is final.
+    bool findOpen(size_t expression_index, const char* begin, const char* attempts_end, const char* end,
+                  bool prev_avail, const char*& match_begin, const char*& match_end, const char*& live);
+};
+
+// Allowance for one std::regex search, charged for every character the engine reads.
+// libstdc++ backtracks recursively, so besides steps and a deadline the budget bounds
+// how far the search has grown the stack below the point the budget was created.
+// Once any limit is hit, charge() throws RegexBudget::Exceeded so the search can be
+// abandoned instead of pinning its worker or overflowing its stack.
+class RegexBudget {
+private:
+    uint64_t steps = 0;
+    uint64_t max_steps;
+    std::chrono::steady_clock::time_point deadline;
+    uintptr_t stack_limit;
+    
+    void checkLimits(uintptr_t stack_position) const;   // Throws Exceeded when a limit is hit
+    
+public:
+    struct Exceeded : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+    
+    static const uint64_t CLOCK_INTERVAL = 64 * 1024;  // Steps between deadline checks
+    static const size_t MAX_STACK_DEPTH = 1024 * 1024; // Well inside the smallest common thread stack
+    
+    RegexBudget(uint64_t max_steps, std::chrono::steady_clock::time_point deadline);
+    
+    void charge() {
+        char marker;
+        uintptr_t stack_position = reinterpret_cast<uintptr_t>(&marker);
+        if (++steps % CLOCK_INTERVAL == 0 || steps > max_steps || stack_position < stack_limit) {
+            checkLimits(stack_position);
+        }
+    }
+};
+
+// const char* iterator that charges a RegexBudget on every dereference
+class BudgetIterator {
+private:
+    const char* position = nullptr;
+    RegexBudget* budget = nullptr;
+    
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+    
+    BudgetIterator() = default;
+    BudgetIterator(const char* position, RegexBudget* budget) : position(position), budget(budget) {}
+    
+    const char* base() const { return position; }
+    reference operator*() const { budget->charge(); return *position; }
+    BudgetIterator& operator++() { ++position; return *this; }
+    BudgetIterator operator++(int) { BudgetIterator old = *this; ++position; return old; }
+    BudgetIterator& operator--() { --position; return *this; }
+    BudgetIterator operator--(int) { BudgetIterator old = *this; --position; return old; }
+    bool operator==(const BudgetIterator& other) const { return position == other.position; }
+    bool operator!=(const BudgetIterator& other) const { return position != other.position; }
+};
+
+// A window in which an expression could not be searched with std::regex
+struct ScanDiagnostic {
+    enum class Kind { LINEAR_FALLBACK, SKIPPED, MATCH_TOO_LONG };
+    
+    Kind kind;
+    uint32_t expression_id;
+    std::string file;
+    uint64_t offset;             // Where the abandoned search started, or where the unreported match starts
+    std::string reason;
+};
+
+// A compiled expression set on disk: the expressions with their literals, the prefilter
+// tables and both automata, keyed by a hash of the properties file so an edited file is
+// recompiled. std::regex cannot be serialized; cached expressions build it on first use.
+class PatternCache {
+public:
+    // FNV-1a of the properties file and the cache layout; false if the file cannot be read
+    static bool propertiesHash(const std::string& properties_path, uint64_t& hash);
+    
+    // Memory-maps cache_path; false if it is missing, corrupt or for other properties
+    static bool load(const std::string& cache_path, uint64_t hash, std::vector<ExpressionPattern>& expressions,
+                     LiteralPrefilter& prefilter, PatternAutomaton& automaton, PatternAutomaton& reverse_automaton);
+    static bool save(const std::string& cache_path, uint64_t hash, const std::vector<ExpressionPattern>& expressions,
+                     const LiteralPrefilter& prefilter, const PatternAutomaton& automaton,
+                     const PatternAutomaton& reverse_automaton);
+};
+
+// Read-only memory mapping of a whole file. isMapped() is false when the file
+// cannot be mapped (special files, mmap failure) and the caller should stream it.
+// With require_settled, files written in the last SETTLE_SECONDS are not mapped either:
+// a writer truncating one (copytruncate log rotation) would fault the reader with
+// SIGBUS, where a streamed read just ends early.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    
+public:
+    static constexpr time_t SETTLE_SECONDS = 300;
+    
+    explicit MappedFile(const std::string& filepath, bool require_settled = false);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool isMapped() const;
+    const char* data() const;
+    size_t size() const;
+};
+
+// Whole-file reads kept in flight ahead of the matcher threads, for storage where every
+// open and read waits on the network or a cold disk. Reads go through io_uring (open,
+// statx and readv requests) when the kernel supports them and through a pool of blocking
+// reader threads otherwise; either way at most depth files are outstanding, independent
+// of how many threads match.
+class ReadAhead {
+public:
+    // Receives the file bytes, or an errno value and no bytes, on a reader thread
+    using Completion = std::function<void(std::vector<char>&& data, int error)>;
+    
+    static const size_t MAX_DEPTH = 4096;
+    static constexpr size_t RING_FALLBACK_READERS = 2;   // Blocking readers beside the ring
+    
+    explicit ReadAhead(size_t depth);   // Clamped to [1, MAX_DEPTH]
+    ~ReadAhead();                  // Waits for outstanding reads
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+    
+    // Starts reading filepath; blocks while depth reads are outstanding
+    void submit(const std::string& filepath, Completion done);
+    void drain();                  // Blocks until every submitted read has completed
+    bool usesIoUring() const { return ring_fd >= 0; }
+    
+private:
+    struct Read {
+        std::string path;
+        int fd = -1;
+        std::vector<char> data;
+        size_t filled = 0;
+        struct iovec iov;
+        Completion done;
+#if USE_IO_URING
+        uint8_t opcode = 0;         // Ring request in flight: OPENAT, then STATX, then READV
+        struct statx stx;
+#endif
+    };
+    
+    size_t depth;
+    std::mutex mutex;
+    std::condition_variable slot_cv;   // An outstanding read completed
+    std::condition_variable work_cv;   // Fallback: a read was queued, or stopping
+    size_t outstanding = 0;
+    bool stopping = false;
+    std::deque<std::unique_ptr<Read>> pending;   // Fallback or refused by the ring: reads no reader thread has taken
+    std::vector<std::thread> threads;
+    
+    int ring_fd = -1;
+#if USE_IO_URING
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    std::unordered_set<Read*> in_ring;   // Reads with a request on the ring; guarded by mutex
+    
+    bool setupRing();
+    void closeRing();
+    int pushSqe(uint8_t opcode, Read* read);    // Caller holds mutex; 0 or the submit errno
+    void resubmit(Read* read, uint8_t opcode);
+    void abandonRing();                         // Hands every read on the ring to the fallback readers
+    void completionThread();
+#endif
+    
+    static bool openRead(Read& read, int& error);
+    static int readBlocking(Read& read);        // Finishes a read synchronously; 0 or errno
+    void finish(Read* read, int error);
+    void readerThread();
+};
+
+// Offsets of every newline in a segment, collected in one pass so line numbers and
+// line bounds for any number of matches come from binary searches
+class LineIndex {
+private:
+    std::vector<size_t> newlines;
+    size_t segment_size = 0;
+    
+public:
+    void build(const char* begin, const char* end);
+    size_t newlinesBefore(size_t offset) const;  // Line of offset, relative to the segment start
+    size_t lineStart(size_t offset) const;       // Offset of the first byte of that line
+    size_t lineEnd(size_t offset) const;         // Offset of the next newline at or after offset
 };
 
+// Position of the sliding-window scan within one file. Offsets are absolute file offsets.
+struct WindowCursor {
+    size_t base = 0;                 // Start of the next window's owned region
+    size_t line_number = 1;          // Line number at base
+    size_t lookahead = 0;            // Bytes scanned past the owned region
+    std::vector<size_t> resume;      // Per expression: where its next search starts
+};
+
+// Append-only Finding storage in fixed-size chunks. Elements never move once added,
+// so growing costs one chunk allocation instead of relocating everything stored.
+class FindingArena {
+private:
+    std::vector<std::vector<Finding>> chunks;   // Each reserved to CHUNK_SIZE up front
+    size_t count = 0;
+    
+public:
+    static const size_t CHUNK_SIZE = 4096;
+    
+    class const_iterator {
+    private:
+        const FindingArena* arena;
+        size_t index;
+        
+    public:
+        const_iterator(const FindingArena* arena, size_t index) : arena(arena), index(index) {}
+        const Finding& operator*() const { return arena->chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+        const Finding* operator->() const { return &**this; }
+        const_iterator& operator++() { ++index; return *this; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+    
+    void push_back(Finding&& finding);
+    void truncate(size_t new_count);   // Drops the findings from new_count onwards
+    const Finding& operator[](size_t index) const { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+};
+
+// One FindingArena per worker thread, so recording a finding takes no lock. Once the
+// workers have finished, the shards read as a single sequence.
+class FindingShards {
+private:
+    std::vector<FindingArena> shards;
+    
+public:
+    class const_iterator {
+    private:
+        const std::vector<FindingArena>* shards;
+        size_t shard;
+        FindingArena::const_iterator position;
+        
+        void skipExhausted();
+        
+    public:
+        const_iterator(const std::vector<FindingArena>* shards, size_t shard);
+        const Finding& operator*() const { return *position; }
+        const Finding* operator->() const { return &*position; }
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+    
+    void reset(size_t shard_count);
+    FindingArena& shard(size_t index) { return shards[index]; }
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    const_iterator begin() const { return const_iterator(&shards, 0); }
+    const_iterator end() const { return const_iterator(&shards, shards.size()); }
+};
+
+// Persistent per-file scan results for incremental rescans. Entries are keyed by path
+// and validated by size, mtime and inode; a cache written for a different expression
+// set is ignored as a whole.
+class ScanCache {
+public:
+    struct FileKey {
+        uint64_t size = 0;
+        uint64_t mtime_ns = 0;
+        uint64_t inode = 0;
+        
+        bool operator==(const FileKey& other) const {
+            return size == other.size && mtime_ns == other.mtime_ns && inode == other.inode;
+        }
+    };
+    
+    struct Entry {
+        FileKey key;
+        bool is_text = false;
+        std::string lines;               // The file's line store
+        std::vector<Finding> findings;   // file_id is assigned on replay
+    };
+    
+    static bool fileKey(const std::string& filepath, FileKey& key);
+    
+    // Returns false if the file is missing, unreadable, corrupt or for another expression set
+    bool load(const std::string& cache_path, uint64_t expression_hash, size_t expression_count);
+    
+    // Moves out the cached entry for filepath if its key still matches
+    bool take(const std::string& filepath, const FileKey& key, Entry& entry);
+    
+    // Notes the outcome of a file in this run; file_id is -1 when it had no findings
+    void record(const std::string& filepath, const FileKey& key, bool is_text, int64_t file_id);
+    
+    // Writes every file recorded in this run, with its line store and findings
+    bool save(const std::string& cache_path, const std::deque<FileRecord>& files, 
+              const FindingShards& findings) const;
+    
+    size_t loadedCount() const { return previous.size(); }
+    
+    // True while an entry for filepath is still waiting to be taken
+    bool has(const std::string& filepath) const;
+    
+private:
+    struct Record {
+        std::string path;
+        FileKey key;
+        bool is_text;
+        int64_t file_id;
+    };
+    
+    uint64_t expression_hash = 0;
+    std::unordered_map<std::string, Entry> previous;   // Loaded from disk
+    std::vector<Record> current;                       // Files seen in this run
+    mutable std::mutex mutex;
+};
+
+// One finding as the output sinks see it. The views point into the analyzer's line
+// stores: they stay valid until write() returns, or until finish() for sinks that are
+// not streaming.
+struct FindingRecord {
+    uint32_t expression_id;
+    std::string_view expression;
+    std::string_view file;
+    uint32_t line_number;
+    std::string_view statement;    // The full line containing the match
+    uint32_t match_offset;         // Position of the match within statement
+    uint32_t match_length;
+    
+    std::string_view match() const { return statement.substr(match_offset, match_length); }
+};
+
+// Destination for findings. Streaming sinks are handed each file's findings as soon as
+// a worker finishes the file; the others are fed every finding once the scan is done.
+// The analyzer serialises all calls.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    
+    // Formats: xlsx (when built with libxlsxwriter), xml, jsonl, csv, bin
+    static std::unique_ptr<OutputSink> create(const std::string& format, const std::string& output_file);
+    
+    virtual bool streaming() const { return true; }
+    virtual void begin(const std::vector<std::string>& expression_names) { (void)expression_names; }
+    virtual void write(const FindingRecord& record) = 0;
+    virtual void finish() = 0;   // Throws if the output cannot be completed
+};
+
+// Base for sinks that append records to one file through a large user-space buffer
+class FileSink : public OutputSink {
+protected:
+    std::string path;
+    const char* description;
+    std::vector<char> file_buffer;     // Declared before file so it outlives the stream
+    std::ofstream file;
+    std::string record_buffer;         // Record being rendered
+    size_t record_count = 0;
+    
+    void emit(); // Writes and clears record_buffer
+    
+public:
+    static const size_t FILE_BUFFER_SIZE = 1024 * 1024;
+    
+    FileSink(const std::string& filename, const char* description);
+    void finish() override;
+};
+
+// One JSON object per line: expression, file, line, match, statement
+class JsonLinesSink : public FileSink {
+public:
+    static void appendString(std::string& out, std::string_view text);   // Quoted and escaped
+    
+    explicit JsonLinesSink(const std::string& filename);
+    void write(const FindingRecord& record) override;
+};
+
+// RFC 4180 CSV with a header row
+class CsvSink : public FileSink {
+private:
+    static void appendField(std::string& out, std::string_view text);
+    
+public:
+    explicit CsvSink(const std::string& filename);
+    void begin(const std::vector<std::string>& expression_names) override;
+    void write(const FindingRecord& record) override;
+};
+
+// Compact binary records, all integers little-endian u32:
+//   header:  "WHSTFND1", expression count, then per expression: length, name bytes
+//   'F':     length, path bytes - starts the findings of a file
+//   'M':     expression id, line, match offset, match length, statement length,
+//            statement bytes - one finding in the current file
+class BinarySink : public FileSink {
+private:
+    std::string current_file;
+    
+    void appendU32(uint32_t value);
+    void appendBytes(std::string_view bytes);
+    
+public:
+    explicit BinarySink(const std::string& filename);
+    void begin(const std::vector<std::string>& expression_names) override;
+    void write(const FindingRecord& record) override;
+};
+
+// XML Spreadsheet 2003 workbook: a sheet per expression plus a Summary of every finding
+class XMLSpreadsheetSink : public OutputSink {
+private:
+    std::string path;
+    XMLSpreadsheetWriter writer;
+    std::map<std::string, size_t, std::less<>> sheet_counts;
+    size_t total = 0;
+    
+    void addHeader(const std::string& sheet_name);
+    
+public:
+    explicit XMLSpreadsheetSink(const std::string& filename);
+    void write(const FindingRecord& record) override;
+    void finish() override;
+};
+
+#if USE_XLSX
+// XLSX workbook. Sheets are laid out in expression order once every finding is known,
+// so this sink is fed after the scan rather than streamed.
+class XLSXSink : public OutputSink {
+private:
+    std::string path;
+    std::vector<FindingRecord> records;
+    
+public:
+    explicit XLSXSink(const std::string& filename);
+    bool streaming() const override { return false; }
+    void write(const FindingRecord& record) override;
+    void finish() override;
+};
+#endif
+
+// Cost of one expression over a scan. Only its own searches (std::regex or the linear
+// fallback) are attributed; the shared prefilter and automaton passes are not.
+struct ExpressionCost {
+    uint64_t regex_ns = 0;       // Time spent searching
+    uint64_t bytes = 0;          // Bytes searched
+    uint64_t searches = 0;       // Windows searched
+    uint64_t matches = 0;
+    uint64_t worst_ns = 0;       // Slowest single window
+    std::string worst_file;      // Where that window was
+    uint64_t worst_offset = 0;
+    
+    void add(const ExpressionCost& other);
+};
+
+// A file of at least CHUNK_THRESHOLD bytes, split into line-aligned byte ranges that
+// workers scan in parallel. Each chunk keeps its own statement store and findings with
+// chunk-relative line numbers; whoever finishes the last chunk merges them in order.
+// Mapped files are scanned in place. The others (written too recently to map, see
+// MappedFile) are read with pread up to the size they had when split, so a writer
+// truncating one only ends its chunks early.
+struct ChunkedFile {
+    struct Chunk {
+        size_t begin = 0;
+        size_t end = 0;
+        FileRecord record;                 // Statement store of this chunk only
+        std::vector<Finding> findings;     // Line numbers relative to begin
+        std::vector<size_t> match_starts;  // File offset of each finding's match
+        std::vector<size_t> reach;         // Per expression: end of its last match, at least end
+        size_t newlines = 0;               // Newlines in [begin, end)
+        bool incomplete = false;           // Some matches were skipped or not reported
+    };
+    
+    std::string path;
+    uint32_t target = 0;
+    std::shared_ptr<const MappedFile> mapping;   // Null when the chunks are read from fd
+    int fd = -1;                           // Owned; open until the chunks are merged
+    size_t size = 0;                       // File size when split
+    std::vector<Chunk> chunks;
+    std::atomic<size_t> remaining{0};      // Chunks not scanned yet
+    bool cacheable = false;
+    ScanCache::FileKey key;
+    
+    ~ChunkedFile();
+    // Copies up to count bytes from offset. Fewer come back past size, once the file has
+    // shrunk, or after a read error, which ends the data early as for a streamed read.
+    size_t read(size_t offset, size_t count, char* out) const;
+};
+
+// Per-worker matching state reused across files
+struct ScanContext {
+    AutomatonScanner scanner;
+    AutomatonScanner reverse_scanner;
+    std::vector<char> hits;            // Expressions to run std::regex for in the current segment
+    std::vector<char> automaton_hits;
+    std::vector<size_t> match_ends;    // Per expression: where the automaton saw its last match end
+    std::vector<char> located;         // Expressions whose match starts the automaton found
+    std::vector<std::vector<uint32_t>> located_starts;  // Per located expression: offsets from the window base where its matches start, last first
+    std::vector<char> live;            // Expressions with an attempt from the owned region still running at the window end
+    LineIndex line_index;
+    FindingArena& findings;            // This worker's shard
+    FileRecord* file = nullptr;        // Interned record of the current file, set at its first finding
+    uint32_t file_id = 0;
+    uint32_t target = 0;               // Scan target of the current file
+    std::unordered_map<size_t, std::pair<size_t, uint64_t>> stored_lines;  // Line start -> (line end, store offset)
+    std::vector<ExpressionCost> costs;  // Per expression; empty unless profiling
+    LinearMatcher linear_matcher;
+    std::vector<uint64_t> regex_ns;     // Per expression: std::regex time spent on the current file
+    std::vector<char> regex_abandoned;  // Per expression: std::regex not used for the rest of the current file
+    std::vector<ScanDiagnostic> diagnostics;
+    bool incomplete = false;            // A SKIPPED or MATCH_TOO_LONG diagnostic was recorded for the current file or chunk
+    std::shared_ptr<ChunkedFile> split;  // Set by scanFile when it split the current file into chunks
+    std::vector<size_t>* match_starts = nullptr;  // When set, receives the file offset of each match
+    
+    ScanContext(const PatternAutomaton& automaton, const PatternAutomaton& reverse_automaton, FindingArena& findings) 
+        : scanner(automaton), reverse_scanner(reverse_automaton), findings(findings), linear_matcher(automaton) {}
+};
+
+// Progress counters that workers bump without locking. While running, a reporter
+// thread samples them a few times per second and redraws a single status line.
 class ProgressTracker {
 private:
     std::atomic<int> processed{0};
     std::atomic<int> total{0};
+    std::atomic<bool> total_final{true};   // False while discovery is still adding to total
+    std::atomic<uint64_t> bytes{0};        // Bytes scanned
+    std::atomic<uint64_t> total_bytes{0};  // Sizes of the files discovered so far
+    std::atomic<uint64_t> done_bytes{0};   // Sizes of the files finished, whether scanned, skipped or cached
     std::chrono::steady_clock::time_point start_time;
-    mutable std::mutex print_mutex;
+    
+    std::thread reporter;
+    std::mutex reporter_mutex;
+    std::condition_variable reporter_cv;
+    bool stopping = false;
+    
+    void reportLoop(std::chrono::milliseconds interval);
+    void printProgress() const;
     
 public:
+    static constexpr std::chrono::milliseconds REPORT_INTERVAL{250};
+    
+    ~ProgressTracker();
+    
     void setTotal(int t);
+    void addTotal(int n, uint64_t size = 0);  // Grows the totals while discovery runs
+    void finishTotal();        // Discovery finished; total is now exact
     void increment();
-    void printProgress() const;
+    void addBytes(uint64_t n);
+    void finishBytes(uint64_t n);             // Work of size n left the queue for good
+    uint64_t byteCount() const { return bytes.load(); }
+    uint64_t remainingBytes() const;
+    
+    void start(std::chrono::milliseconds interval = REPORT_INTERVAL);
+    void stop();               // Stops the reporter and prints the final status
+};
+
+// Per-stage timings of the last analyze() run, for benchmarking. Stages that run on
+// several workers at once are summed over the workers, so they can exceed the wall time.
+struct StageTimings {
+    double total_seconds = 0;    // Wall time of analyze()
+    double walk_seconds = 0;     // Directory traversal (wall)
+    double detect_seconds = 0;   // Text/binary classification (summed)
+    double match_seconds = 0;    // Regex matching (summed)
+    double write_seconds = 0;    // Producing the output (summed)
+    uint64_t files = 0;          // Text files scanned
+    uint64_t bytes = 0;          // Bytes scanned
+    uint64_t findings = 0;
+};
+
+// Adds its own lifetime, in nanoseconds, to a shared counter
+class StageTimer {
+private:
+    std::atomic<uint64_t>& total_ns;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+public:
+    explicit StageTimer(std::atomic<uint64_t>& total_ns) : total_ns(total_ns) {}
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        total_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+// Per-expression costs of the last scan, merged from the workers once they finish, with
+// the expressions likely to dominate scan time flagged
+class ExpressionProfile {
+private:
+    std::vector<ExpressionCost> costs;
+    std::mutex mutex;
+    
+    std::vector<std::string> flags(const std::vector<ExpressionPattern>& expressions, size_t index,
+                                   double median_ns_per_byte) const;
+    double medianNsPerByte() const;
+    
+public:
+    static const uint64_t SLOW_WINDOW_NS = 100 * 1000 * 1000;  // A single window this slow is flagged
+    static constexpr double SLOW_FACTOR = 8.0;                 // Cost per byte this far above the median is flagged
+    
+    void reset(size_t expression_count);
+    void merge(const std::vector<ExpressionCost>& worker_costs);
+    const std::vector<ExpressionCost>& expressionCosts() const { return costs; }
+    
+    // Table sorted by time, most expensive first
+    void print(const std::vector<ExpressionPattern>& expressions) const;
+    bool writeJson(const std::string& path, const std::vector<ExpressionPattern>& expressions) const;
+};
+
+// Parallel directory traversal. Each walker thread takes a pending directory, lists it
+// (getdents64 on Linux) and pushes subdirectories back for any idle walker, reporting
+// regular files through the callback as soon as they are seen.
+class DirectoryWalker {
+public:
+    using FileCallback = std::function<void(const std::string& path, uint32_t root, uint64_t size)>;
+    
+private:
+    // Directories of every root share one stack, so walkers interleave the roots
+    std::vector<std::pair<std::string, uint32_t>> pending_dirs;
+    std::mutex dirs_mutex;
+    std::condition_variable dirs_cv;
+    int busy_walkers = 0;
+    FileCallback on_file;
+    
+    void walkerThread();
+    void listDirectory(const std::string& path, uint32_t root, std::vector<std::string>& subdirs);
+    
+public:
+    // Blocks until every directory under the roots has been listed. The callback gets
+    // each regular file with the index of the root it was found under and its size.
+    void walk(const std::vector<std::string>& roots, int num_threads, FileCallback callback);
+};
+
+// One root of a scan with the outputs its findings go to. A batch run has one per
+// manifest entry; the workers, queue and compiled expressions are shared by all of them.
+struct ScanTarget {
+    std::string directory;
+    std::string output_file;
+    std::vector<std::unique_ptr<OutputSink>> sinks;
+    std::atomic<size_t> discovered{0};
+    std::atomic<size_t> text_files{0};
+    std::atomic<size_t> findings{0};
+    
+    ScanTarget(std::string directory, std::string output_file)
+        : directory(std::move(directory)), output_file(std::move(output_file)) {}
+};
+
+// A discovered file, or one chunk of a split file, waiting for a worker. The queue is a
+// max-heap on size so the longest work starts first and small files fill in the tail.
+struct QueuedFile {
+    std::string path;
+    uint32_t target = 0;
+    std::shared_ptr<ChunkedFile> chunked;   // Set for a chunk
+    size_t chunk = 0;
+    uint64_t size = 0;                      // File size at discovery, or chunk length
+    
+    bool operator<(const QueuedFile& other) const { return size < other.size; }
+};
+
+// A queued file handed to a worker, with its bytes when they were read ahead
+struct LoadedFile {
+    QueuedFile item;
+    std::vector<char> data;
+    bool loaded = false;                    // False: the worker maps or reads the file itself
+    uint64_t reserved = 0;                  // Read-ahead bytes held until the file is scanned
 };
 
 class RegexAnalyzer {
 private:
     std::vector<ExpressionPattern> expressions;
-    std::vector<std::string> file_queue;
+    std::vector<QueuedFile> file_queue;    // Heap ordered by size
     std::mutex queue_mutex;
-    std::mutex findings_mutex;
-    std::vector<Finding> all_findings;
+    std::condition_variable queue_cv;
+    bool discovery_done = false;
+    int busy_workers = 0;                  // Workers holding a queue item; a file may still split into chunks
+    int worker_count = 0;
+    size_t read_ahead_depth = 0;           // Reads in flight ahead of the workers; 0 maps files in place
+    std::deque<LoadedFile> ready_queue;    // Read-ahead mode: files waiting for a worker, under queue_mutex
+    std::condition_variable ready_cv;
+    bool feeding_done = false;
+    size_t reads_in_flight = 0;
+    uint64_t read_ahead_bytes = 0;         // Read or being read, not yet scanned
+    std::atomic<size_t> text_file_count{0};
+    FindingShards all_findings;
+    std::deque<FileRecord> file_records;   // Indexed by Finding::file_id; records stay in place as it grows
+    std::mutex file_records_mutex;
+    std::string cache_file;                // Empty when incremental rescans are off
+    std::string pattern_cache_file;        // Empty when compiled expressions are not cached
+    ScanCache cache;
+    std::atomic<size_t> cached_file_count{0};
+    std::vector<std::string> output_formats;   // Empty selects the spreadsheet format
+    std::deque<ScanTarget> targets;        // Roots of the current run, indexed by FileRecord::target
+    std::mutex output_mutex;               // Serialises sink calls
+    bool retain_findings = true;           // Keep findings after streaming them (cache, non-streaming sinks)
+    std::atomic<size_t> finding_count{0};
+    bool verbose = false;                  // Log each expression and file as it is processed
+    StageTimings stage_timings;
+    bool profiling = false;                // Collect per-expression costs
+    std::string profile_file;              // JSON profile destination, empty for the console report only
+    ExpressionProfile profile;
+    std::chrono::nanoseconds regex_budget{std::chrono::seconds(1)};   // std::regex time per (file, expression)
+    std::vector<char> linear_only;         // Per expression: never handed to std::regex
+    std::vector<ScanDiagnostic> diagnostics;
+    std::mutex diagnostics_mutex;
+    std::atomic<uint64_t> detect_ns{0};
+    std::atomic<uint64_t> match_ns{0};
+    std::atomic<uint64_t> write_ns{0};
     ProgressTracker progress;
+    MatchEngine match_engine = MatchEngine::AUTOMATON;
+    PatternAutomaton automaton;
+    PatternAutomaton reverse_automaton;    // Finds where the matches the automaton reports begin
+    LiteralPrefilter prefilter;
     
     std::vector<ExpressionPattern> loadExpressions(const std::string& filename);
-    bool isTextFile(const std::string& filepath);
-    void processFile(const std::string& filepath);
-    std::vector<std::string> findTextFiles(const std::string& directory);
-    void workerThread();
+    void compileExpressions(const std::string& expressions_file);   // Loads, or reuses the pattern cache
+    static bool isTextFile(const char* sample, size_t size);
+    bool detectText(const char* sample, size_t size);   // Timed isTextFile
+    static const size_t TEXT_SAMPLE_SIZE = 8 * 1024;     // Leading bytes classified as text or binary
+    static const size_t READ_SIZE = 64 * 1024;           // Streamed read size when a file cannot be mapped
+    static const size_t WINDOW_SIZE = 32 * 1024;         // Bytes each window owns matches for
+    static const size_t OVERLAP_SIZE = 16 * 1024;        // Look-ahead past the owned region (and statement look-behind)
+    static const size_t MAX_LOOKAHEAD = 1024 * 1024;     // Look-ahead cap for a single very long match
+    static const size_t CHUNK_THRESHOLD = 64 * 1024 * 1024;  // Files this large are split across workers
+    static const size_t CHUNK_SIZE = 8 * 1024 * 1024;        // Target chunk length before line alignment
+    static const uint64_t READ_AHEAD_LIMIT = 256 * 1024 * 1024;  // Read-ahead bytes held before reads pause
+    static const uint64_t REGEX_STEPS_PER_BYTE = 1024;    // std::regex step budget per byte searched
+    static const uint64_t MIN_REGEX_STEPS = 1024 * 1024;
     
-#if USE_XLSX
-    void writeXLSXResults(const std::string& output_filename);
-#endif
-    void writeXMLSpreadsheetResults(const std::string& output_filename);
+    void findCandidates(const char* begin, const char* base, const char* split, const char* end, ScanContext& context);
+    size_t liveStart(ScanContext& context, size_t expr_idx, const char* data, size_t data_offset,
+                     size_t start, size_t owned_end, size_t limit);
+    void abandonSearch(ScanContext& context, size_t expr_idx, const std::string& filepath,
+                       size_t offset, const std::string& reason);
+    void reportDiagnostics() const;
+    void scanWindow(const char* data, size_t data_offset, size_t owned_end, size_t limit,
+                    size_t data_end, bool final, WindowCursor& cursor, const std::string& filepath,
+                    ScanContext& context);
+    size_t scanWindows(const char* data, size_t size, size_t data_offset, bool at_eof,
+                       WindowCursor& cursor, const std::string& filepath,
+                       ScanContext& context, size_t owned_limit = SIZE_MAX);
+    uint64_t storeStatement(ScanContext& context, const std::string& filepath, 
+                            const char* text, size_t line_start, size_t line_end);
+    enum class FileScanResult { TEXT, BINARY, FAILED, SPLIT };
+    // preloaded holds the file's bytes when they were read ahead
+    FileScanResult scanFile(const std::string& filepath, ScanContext& context, 
+                            const std::vector<char>* preloaded = nullptr);
+    FileScanResult processFile(const std::string& filepath, ScanContext& context,
+                               const std::vector<char>* preloaded = nullptr);
+    // Reads mapping, or when it is null fd, which the chunked file then owns
+    std::shared_ptr<ChunkedFile> splitFile(const std::string& filepath, std::shared_ptr<const MappedFile> mapping,
+                                           int fd, size_t size, uint32_t target);
+    std::vector<size_t> scanChunk(ChunkedFile& file, size_t index, std::vector<size_t> resume, 
+                                  ScanContext& context);
+    void finishChunkedFile(ChunkedFile& file, ScanContext& context);
+    void replayCachedFile(const std::string& filepath, ScanCache::Entry& entry, ScanContext& context);
+    uint64_t expressionSetHash() const;
+    
+    size_t findTextFiles(int num_threads);
+    void workerThread(size_t shard_index);
+    // Read-ahead mode: moves queued files through reader to the ready queue
+    void feederThread(ReadAhead& reader);
+    
+    // Materialise a finding's text at output time
+    FindingRecord outputRecord(const Finding& finding, const FileRecord& file) const;
+    
+    // Opens the sinks of every target
+    void openSinks();
+    // Streams the findings a worker recorded from index first onwards to the sinks of its
+    // file's target, then drops them unless they are retained
+    void emitFindings(ScanContext& context, size_t first);
+    // Feeds the non-streaming sinks and completes every output
+    void writeResults();
+    // Scans every entry of targets with one worker pool
+    void run(const std::string& expressions_file, int num_threads);
     
 public:
+    void setMatchEngine(MatchEngine engine);
+    void setCacheFile(const std::string& path);
+    void setPatternCacheFile(const std::string& path);
+    void setOutputFormats(const std::vector<std::string>& formats);
+    void setVerbose(bool enabled);
+    void setProfile(bool enabled, const std::string& json_path = "");
+    void setRegexBudget(std::chrono::milliseconds budget);
+    void setReadAhead(size_t depth);
+    const StageTimings& timings() const { return stage_timings; }
+    const ExpressionProfile& expressionProfile() const { return profile; }
+    const std::vector<ScanDiagnostic>& scanDiagnostics() const { return diagnostics; }
     void analyze(const std::string& directory, const std::string& expressions_file, 
                 const std::string& output_file, int num_threads = 4);
-    void writeResults(const std::string& output_filename);
+    
+    // Scans several roots in one run, each written to its own output. Entries are
+    // (directory, output_file) pairs.
+    void analyzeBatch(const std::vector<std::pair<std::string, std::string>>& roots,
+                      const std::string& expressions_file, int num_threads = 4);
+    
+    // Reads the [roots] section of a batch manifest: one output_file=directory per line
+    static std::vector<std::pair<std::string, std::string>> loadManifest(const std::string& filename);
 };
 
+// Maps an --engine name (automaton, std-regex) to its MatchEngine
+bool parseMatchEngine(const std::string& name, MatchEngine& engine);
+// Parses a whole decimal option value that must not be negative
+bool parseNonNegative(const char* text, long& value);
 void printUsage(const char* program_name);
 
 #endif // WHISTLE_H